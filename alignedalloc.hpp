@@ -0,0 +1,55 @@
+#ifndef ALIGNEDALLOC_HPP
+#define ALIGNEDALLOC_HPP
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// std::vector allocator whose storage starts on an Alignment boundary, a cache line by default.
+// Arrays the update kernels stream through then never split a SIMD load across two lines,
+// and ranges starting on a multiple of 16 floats give each thread whole lines of its own.
+
+const size_t CacheLineSize = 64;
+
+template <class T, size_t Alignment = CacheLineSize>
+struct AlignedAllocator {
+	typedef T value_type;
+	template <class U> struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+	AlignedAllocator(void) {}
+	template <class U> AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+	T *allocate(size_t count)
+	{
+		const size_t bytes = (count > 0 ? count : 1) * sizeof(T);
+		void *memory;
+#ifdef _WIN32
+		memory = _aligned_malloc(bytes, Alignment);
+#else
+		if (posix_memalign(&memory, Alignment, bytes) != 0)
+			memory = NULL;
+#endif
+		if (memory == NULL)
+			throw std::bad_alloc();
+		return (T*)memory;
+	}
+
+	void deallocate(T *memory, size_t)
+	{
+#ifdef _WIN32
+		_aligned_free(memory);
+#else
+		free(memory);
+#endif
+	}
+};
+
+template <class T, class U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment> &, const AlignedAllocator<U, Alignment> &) { return true; }
+template <class T, class U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment> &, const AlignedAllocator<U, Alignment> &) { return false; }
+
+#endif
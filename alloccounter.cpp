@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+#include "alloccounter.hpp"
+
+static std::atomic<bool> gCounting(false);
+static std::atomic<unsigned long long> gAllocations(0);
+static std::atomic<unsigned long long> gAllocatedBytes(0);
+
+#ifdef COUNT_ALLOCATIONS
+static void *countedAlloc(size_t size)
+{
+	if (gCounting.load(std::memory_order_relaxed)) {
+		gAllocations.fetch_add(1, std::memory_order_relaxed);
+		gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	}
+	void *memory = malloc(size > 0 ? size : 1);
+	if (memory == NULL)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void *operator new(size_t size)
+{
+	return countedAlloc(size);
+}
+
+void *operator new[](size_t size)
+{
+	return countedAlloc(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+	free(memory);
+}
+#endif
+
+bool countingAllocations(void)
+{
+#ifdef COUNT_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+void startCountingAllocations(void)
+{
+	gAllocations = 0;
+	gAllocatedBytes = 0;
+	gCounting = true;
+}
+
+AllocationCounts stopCountingAllocations(void)
+{
+	gCounting = false;
+	AllocationCounts counts;
+	counts.Allocations = gAllocations;
+	counts.Bytes = gAllocatedBytes;
+	return counts;
+}
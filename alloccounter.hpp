@@ -0,0 +1,21 @@
+#ifndef ALLOCCOUNTER_HPP
+#define ALLOCCOUNTER_HPP
+
+// Counts the heap allocations made through operator new between a start and a stop, for
+// the allocation benchmarks. Counting replaces the global operator new and delete, so it is
+// only compiled in with COUNT_ALLOCATIONS defined; other builds keep the standard allocator
+// and every count comes back 0. The replaced operators cost a single flag test while
+// nothing is being counted.
+
+struct AllocationCounts {
+	unsigned long long Allocations;
+	unsigned long long Bytes;
+};
+
+// False when built without COUNT_ALLOCATIONS
+bool countingAllocations(void);
+
+void startCountingAllocations(void);
+AllocationCounts stopCountingAllocations(void);
+
+#endif
@@ -0,0 +1,117 @@
+#include <chrono>
+
+#include "assetloader.hpp"
+
+static void loadWorker(AssetLoader *loader)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	ScratchArena scratch;
+	initScratchArena(scratch);
+
+	for (;;) {
+		LoadedMesh *mesh;
+		{
+			std::unique_lock<std::mutex> lock(loader->Mutex);
+			while (loader->Queued.empty() && !loader->Quit)
+				loader->WorkReady.wait(lock);
+			if (loader->Queued.empty())
+				break;
+			mesh = loader->Queued.front();
+			loader->Queued.pop_front();
+		}
+
+		const Clock::time_point start = Clock::now();
+		loader->Load(*mesh, scratch);
+		resetScratchArena(scratch);
+		mesh->Milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		std::lock_guard<std::mutex> lock(loader->Mutex);
+		loader->Finished.push_back(mesh);
+		loader->MeshReady.notify_all();
+	}
+	freeScratchArena(scratch);
+}
+
+void startAssetLoader(AssetLoader &loader, MeshLoadFunction load, int threads)
+{
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 2;
+
+	loader.Load = load;
+	loader.Outstanding = 0;
+	loader.Quit = false;
+	for (int i = 0; i < threads; i++)
+		loader.Workers.push_back(std::thread(loadWorker, &loader));
+}
+
+void stopAssetLoader(AssetLoader &loader)
+{
+	{
+		std::lock_guard<std::mutex> lock(loader.Mutex);
+		loader.Quit = true;
+		for (size_t i = 0; i < loader.Queued.size(); i++)
+			delete loader.Queued[i];
+		loader.Queued.clear();
+	}
+	loader.WorkReady.notify_all();
+	for (size_t i = 0; i < loader.Workers.size(); i++)
+		loader.Workers[i].join();
+	loader.Workers.clear();
+
+	for (size_t i = 0; i < loader.Finished.size(); i++)
+		releaseLoadedMesh(loader.Finished[i]);
+	loader.Finished.clear();
+	loader.Outstanding = 0;
+}
+
+void queueMeshLoad(AssetLoader &loader, const char *file, int objectId)
+{
+	LoadedMesh *mesh = new LoadedMesh();
+	mesh->File = file;
+	mesh->ObjectId = objectId;
+
+	std::lock_guard<std::mutex> lock(loader.Mutex);
+	loader.Queued.push_back(mesh);
+	loader.Outstanding++;
+	loader.WorkReady.notify_one();
+}
+
+LoadedMesh *takeLoadedMesh(AssetLoader &loader)
+{
+	std::lock_guard<std::mutex> lock(loader.Mutex);
+	if (loader.Finished.empty())
+		return NULL;
+	LoadedMesh *mesh = loader.Finished.front();
+	loader.Finished.pop_front();
+	loader.Outstanding--;
+	return mesh;
+}
+
+LoadedMesh *waitLoadedMesh(AssetLoader &loader)
+{
+	std::unique_lock<std::mutex> lock(loader.Mutex);
+	if (loader.Outstanding == 0)
+		return NULL;
+	while (loader.Finished.empty())
+		loader.MeshReady.wait(lock);
+	LoadedMesh *mesh = loader.Finished.front();
+	loader.Finished.pop_front();
+	loader.Outstanding--;
+	return mesh;
+}
+
+bool assetLoadsPending(AssetLoader &loader)
+{
+	std::lock_guard<std::mutex> lock(loader.Mutex);
+	return loader.Outstanding > 0;
+}
+
+void releaseLoadedMesh(LoadedMesh *mesh)
+{
+	if (mesh->Mapped)
+		unmapMeshCache(mesh->Cache);
+	delete mesh;
+}
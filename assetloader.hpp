@@ -0,0 +1,79 @@
+#ifndef ASSETLOADER_HPP
+#define ASSETLOADER_HPP
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "bvh.hpp"
+#include "meshcache.hpp"
+#include "scratcharena.hpp"
+
+// Mesh loading on a pool of worker threads.
+// Each queued file is parsed, indexed and given its BVH by the load function on whichever
+// worker is free, independently of the others. Finished meshes wait in a queue for the
+// GL thread, which takes them with takeLoadedMesh() between frames, uploads them and
+// releases them; nothing on the workers touches GL or the scene.
+// Each worker keeps a scratch arena for the temporaries of its loads, reset after every one.
+
+struct LoadedMesh {
+	const char *File;
+	int ObjectId;
+	bool Ok;
+
+	// Either into the storage vectors or into the mapped cache file
+	const void *Vertices;
+	const void *Indices;
+	unsigned int VertexCount;
+	unsigned int IndexCount;
+	unsigned int VertexStride;	// bytes
+	unsigned int IndexSize;		// bytes, 2 or 4
+
+	std::vector<unsigned char> VertexStorage;
+	std::vector<unsigned char> IndexStorage;
+	MappedMeshCache Cache;
+	bool Mapped;
+
+	MeshBVH BVH;
+	double Milliseconds;		// time spent on the worker
+};
+
+// Runs on a worker : fills everything from Ok on, scratch is free for temporaries
+typedef void (*MeshLoadFunction)(LoadedMesh &mesh, ScratchArena &scratch);
+
+struct AssetLoader {
+	std::vector<std::thread> Workers;
+	std::mutex Mutex;
+	std::condition_variable WorkReady;
+	std::condition_variable MeshReady;
+	std::deque<LoadedMesh*> Queued;		// waiting for a worker
+	std::deque<LoadedMesh*> Finished;	// waiting for the GL thread
+	int Outstanding;					// queued, loading or finished but not taken yet
+	bool Quit;
+	MeshLoadFunction Load;
+};
+
+// threads 0 uses one worker per hardware thread
+void startAssetLoader(AssetLoader &loader, MeshLoadFunction load, int threads);
+
+// Abandons meshes no worker has started, waits for the rest and frees everything not taken
+void stopAssetLoader(AssetLoader &loader);
+
+// file must outlive the load
+void queueMeshLoad(AssetLoader &loader, const char *file, int objectId);
+
+// Next finished mesh, NULL if none is ready; never waits. The caller owns the mesh.
+LoadedMesh *takeLoadedMesh(AssetLoader &loader);
+
+// Next finished mesh, waiting for one if need be; NULL once nothing is outstanding
+LoadedMesh *waitLoadedMesh(AssetLoader &loader);
+
+// True while any queued mesh hasn't been taken
+bool assetLoadsPending(AssetLoader &loader);
+
+// Unmaps the cache file and frees the mesh
+void releaseLoadedMesh(LoadedMesh *mesh);
+
+#endif
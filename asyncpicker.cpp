@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <string.h>
+#include <GL/glew.h>
+
+#include "asyncpicker.hpp"
+
+bool createAsyncPicker(AsyncPicker &picker, int width, int height, AsyncPickCallback callback)
+{
+	memset(&picker, 0, sizeof(picker));
+	picker.Width = width;
+	picker.Height = height;
+	picker.Callback = callback;
+
+	// Single-sampled ID target, blending between IDs would corrupt them
+	glGenRenderbuffers(1, &picker.ColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, picker.ColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &picker.DepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, picker.DepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &picker.Framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, picker.Framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, picker.ColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, picker.DepthBuffer);
+	const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "ERROR: Picking framebuffer is incomplete (0x%x)\n", status);
+		destroyAsyncPicker(picker);
+		return false;
+	}
+
+	// One RGBA8 pixel per slot
+	glGenBuffers(NumAsyncPickSlots, picker.PixelBuffer);
+	for (int i = 0; i < NumAsyncPickSlots; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, picker.PixelBuffer[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, 4, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return true;
+}
+
+void destroyAsyncPicker(AsyncPicker &picker)
+{
+	for (int i = 0; i < NumAsyncPickSlots; i++) {
+		if (picker.Fence[i])
+			glDeleteSync(picker.Fence[i]);
+		picker.Fence[i] = 0;
+	}
+	glDeleteBuffers(NumAsyncPickSlots, picker.PixelBuffer);
+	glDeleteFramebuffers(1, &picker.Framebuffer);
+	glDeleteRenderbuffers(1, &picker.ColorBuffer);
+	glDeleteRenderbuffers(1, &picker.DepthBuffer);
+	picker.Framebuffer = picker.ColorBuffer = picker.DepthBuffer = 0;
+}
+
+bool beginAsyncPick(AsyncPicker &picker)
+{
+	if (picker.Framebuffer == 0 || picker.Fence[picker.NextSlot] != 0)
+		return false;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, picker.Framebuffer);
+	return true;
+}
+
+void endAsyncPick(AsyncPicker &picker, int x, int y)
+{
+	const int slot = picker.NextSlot;
+
+	// With a pack buffer bound glReadPixels only queues the copy and returns at once
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, picker.PixelBuffer[slot]);
+	glReadPixels(x, y, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	picker.Fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	picker.NextSlot = (slot + 1) % NumAsyncPickSlots;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// Make sure the fence reaches the GPU, otherwise polling it could never succeed
+	glFlush();
+}
+
+void pollAsyncPicks(AsyncPicker &picker)
+{
+	// Oldest in-flight slot first so picks are delivered in click order
+	for (int n = 0; n < NumAsyncPickSlots; n++) {
+		const int slot = (picker.NextSlot + n) % NumAsyncPickSlots;
+		if (picker.Fence[slot] == 0)
+			continue;
+
+		const GLenum state = glClientWaitSync(picker.Fence[slot], 0, 0);
+		if (state == GL_TIMEOUT_EXPIRED)
+			break;
+
+		glDeleteSync(picker.Fence[slot]);
+		picker.Fence[slot] = 0;
+		if (state == GL_WAIT_FAILED)
+			continue;
+
+		unsigned char data[4] = { 255, 255, 255, 255 };
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, picker.PixelBuffer[slot]);
+		const unsigned char *mapped = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 4, GL_MAP_READ_BIT);
+		if (mapped != NULL) {
+			memcpy(data, mapped, 4);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		if (picker.Callback)
+			picker.Callback(int(data[0]));
+	}
+}
+
+bool asyncPicksPending(const AsyncPicker &picker)
+{
+	for (int slot = 0; slot < NumAsyncPickSlots; slot++) {
+		if (picker.Fence[slot] != 0)
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,44 @@
+#ifndef ASYNCPICKER_HPP
+#define ASYNCPICKER_HPP
+
+#include <GL/glew.h>
+
+// Non-blocking color-ID picking.
+// The picking pass is drawn into an offscreen framebuffer, the pixel under the cursor
+// is copied into a pixel-buffer object and a fence is inserted. pollAsyncPicks() checks
+// the fences with a zero timeout each frame and hands finished picks to the callback,
+// usually one or two frames after the click, without ever stalling the render thread.
+
+// Called with the red channel of the picked pixel (255 is the background)
+typedef void (*AsyncPickCallback)(int pickedIndex);
+
+const int NumAsyncPickSlots = 4;	// picks that can be in flight at once
+
+struct AsyncPicker {
+	GLuint Framebuffer;
+	GLuint ColorBuffer;
+	GLuint DepthBuffer;
+	int Width, Height;
+
+	GLuint PixelBuffer[NumAsyncPickSlots];
+	GLsync Fence[NumAsyncPickSlots];	// 0 when the slot is free
+	int NextSlot;
+
+	AsyncPickCallback Callback;
+};
+
+bool createAsyncPicker(AsyncPicker &picker, int width, int height, AsyncPickCallback callback);
+void destroyAsyncPicker(AsyncPicker &picker);
+
+// Bind the offscreen picking framebuffer; returns false if every slot is still in flight
+bool beginAsyncPick(AsyncPicker &picker);
+// Queue the readback of pixel (x, y) (OpenGL window coordinates) and restore the default framebuffer
+void endAsyncPick(AsyncPicker &picker, int x, int y);
+
+// Deliver every pick whose readback has completed, never waits
+void pollAsyncPicks(AsyncPicker &picker);
+
+// True while a pick is still waiting for its readback
+bool asyncPicksPending(const AsyncPicker &picker);
+
+#endif
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+#include "bvh.hpp"
+
+// Triangles per leaf before a node is split
+static const int MaxLeafTriangles = 4;
+
+struct BuildTriangle {
+	glm::vec3 Centroid;
+	glm::vec3 BoundsMin, BoundsMax;
+	int Id;
+};
+
+static int buildNode(MeshBVH &bvh, BuildTriangle *tris, int first, int count)
+{
+	const int nodeIndex = (int)bvh.Nodes.size();
+	bvh.Nodes.push_back(BVHNode());
+
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+	glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+	for (int i = first; i < first + count; i++) {
+		boundsMin = glm::min(boundsMin, tris[i].BoundsMin);
+		boundsMax = glm::max(boundsMax, tris[i].BoundsMax);
+		centroidMin = glm::min(centroidMin, tris[i].Centroid);
+		centroidMax = glm::max(centroidMax, tris[i].Centroid);
+	}
+	bvh.Nodes[nodeIndex].BoundsMin = boundsMin;
+	bvh.Nodes[nodeIndex].BoundsMax = boundsMax;
+
+	if (count <= MaxLeafTriangles) {
+		bvh.Nodes[nodeIndex].First = first;
+		bvh.Nodes[nodeIndex].Count = count;
+		return nodeIndex;
+	}
+
+	// Median split along the longest centroid axis
+	const glm::vec3 extent = centroidMax - centroidMin;
+	int axis = 0;
+	if (extent.y > extent.x) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	const int half = count / 2;
+	std::nth_element(tris + first, tris + first + half, tris + first + count,
+		[axis](const BuildTriangle &a, const BuildTriangle &b) { return a.Centroid[axis] < b.Centroid[axis]; });
+
+	buildNode(bvh, tris, first, half);
+	const int right = buildNode(bvh, tris, first + half, count - half);
+
+	bvh.Nodes[nodeIndex].First = right;
+	bvh.Nodes[nodeIndex].Count = 0;
+	return nodeIndex;
+}
+
+void buildMeshBVH(MeshBVH &bvh, const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices)
+{
+	buildMeshBVH(bvh, positions.empty() ? NULL : &positions[0], positions.size(), indices.empty() ? NULL : &indices[0], indices.size(), NULL);
+}
+
+void buildMeshBVH(MeshBVH &bvh, const glm::vec3 *positions, size_t positionCount, const unsigned int *indices, size_t indexCount, ScratchArena *scratch)
+{
+	const int triangleCount = (int)(indexCount / 3);
+
+	bvh.Nodes.clear();
+	bvh.Positions.assign(positions, positions + positionCount);
+	bvh.Triangles.resize(triangleCount * 3);
+	bvh.TriangleIds.resize(triangleCount);
+	if (triangleCount == 0)
+		return;
+
+	std::vector<BuildTriangle> heapTris;
+	BuildTriangle *tris;
+	if (scratch != NULL)
+		tris = scratchArray<BuildTriangle>(*scratch, triangleCount);
+	else {
+		heapTris.resize(triangleCount);
+		tris = &heapTris[0];
+	}
+	for (int t = 0; t < triangleCount; t++) {
+		const glm::vec3 &a = positions[indices[3 * t]];
+		const glm::vec3 &b = positions[indices[3 * t + 1]];
+		const glm::vec3 &c = positions[indices[3 * t + 2]];
+		tris[t].BoundsMin = glm::min(a, glm::min(b, c));
+		tris[t].BoundsMax = glm::max(a, glm::max(b, c));
+		tris[t].Centroid = (a + b + c) / 3.0f;
+		tris[t].Id = t;
+	}
+
+	bvh.Nodes.reserve(triangleCount);
+	buildNode(bvh, tris, 0, triangleCount);
+
+	// Store triangles in leaf order so a leaf reads one contiguous run
+	for (int t = 0; t < triangleCount; t++) {
+		const int id = tris[t].Id;
+		bvh.TriangleIds[t] = id;
+		bvh.Triangles[3 * t] = indices[3 * id];
+		bvh.Triangles[3 * t + 1] = indices[3 * id + 1];
+		bvh.Triangles[3 * t + 2] = indices[3 * id + 2];
+	}
+}
+
+// Slab test, returns the entry distance or FLT_MAX on a miss
+static inline float intersectBounds(const BVHNode &node, glm::vec3 origin, glm::vec3 invDirection, float maxDistance)
+{
+	const glm::vec3 t0 = (node.BoundsMin - origin) * invDirection;
+	const glm::vec3 t1 = (node.BoundsMax - origin) * invDirection;
+	const glm::vec3 tNear = glm::min(t0, t1);
+	const glm::vec3 tFar = glm::max(t0, t1);
+	const float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+	const float leave = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxDistance));
+	return enter <= leave ? enter : FLT_MAX;
+}
+
+// Moller-Trumbore, double sided since picking should also hit back faces
+static inline bool intersectTriangle(glm::vec3 origin, glm::vec3 direction, glm::vec3 a, glm::vec3 b, glm::vec3 c, float &t, float &u, float &v)
+{
+	const glm::vec3 edge1 = b - a;
+	const glm::vec3 edge2 = c - a;
+	const glm::vec3 p = glm::cross(direction, edge2);
+	const float det = glm::dot(edge1, p);
+	if (fabsf(det) < 1e-12f)
+		return false;
+
+	const float invDet = 1.0f / det;
+	const glm::vec3 s = origin - a;
+	u = glm::dot(s, p) * invDet;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+
+	const glm::vec3 q = glm::cross(s, edge1);
+	v = glm::dot(direction, q) * invDet;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+
+	t = glm::dot(edge2, q) * invDet;
+	return t >= 0.0f;
+}
+
+bool intersectMeshBVH(const MeshBVH &bvh, glm::vec3 origin, glm::vec3 direction, RayHit &hit)
+{
+	if (bvh.Nodes.empty())
+		return false;
+
+	const glm::vec3 invDirection = glm::vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	bool found = false;
+
+	int stack[64];
+	int top = 0;
+	if (intersectBounds(bvh.Nodes[0], origin, invDirection, hit.Distance) == FLT_MAX)
+		return false;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		const BVHNode &node = bvh.Nodes[stack[--top]];
+
+		if (node.Count > 0) {
+			for (int i = node.First; i < node.First + node.Count; i++) {
+				float t, u, v;
+				const glm::vec3 &a = bvh.Positions[bvh.Triangles[3 * i]];
+				const glm::vec3 &b = bvh.Positions[bvh.Triangles[3 * i + 1]];
+				const glm::vec3 &c = bvh.Positions[bvh.Triangles[3 * i + 2]];
+				if (intersectTriangle(origin, direction, a, b, c, t, u, v) && t < hit.Distance) {
+					hit.Distance = t;
+					hit.Triangle = bvh.TriangleIds[i];
+					hit.U = u;
+					hit.V = v;
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first so the far one is usually culled by the closer hit
+		const int left = (int)(&node - &bvh.Nodes[0]) + 1;
+		const int right = node.First;
+		const float leftDistance = intersectBounds(bvh.Nodes[left], origin, invDirection, hit.Distance);
+		const float rightDistance = intersectBounds(bvh.Nodes[right], origin, invDirection, hit.Distance);
+
+		if (leftDistance <= rightDistance) {
+			if (rightDistance != FLT_MAX) stack[top++] = right;
+			if (leftDistance != FLT_MAX) stack[top++] = left;
+		}
+		else {
+			if (leftDistance != FLT_MAX) stack[top++] = left;
+			if (rightDistance != FLT_MAX) stack[top++] = right;
+		}
+	}
+
+	return found;
+}
@@ -0,0 +1,40 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "scratcharena.hpp"
+
+// Bounding-volume hierarchy over the triangles of one indexed mesh, in model space.
+// Nodes are stored depth-first : an inner node's left child directly follows it and
+// its First holds the index of the right one. Leaves own Count triangles from First on.
+struct BVHNode {
+	glm::vec3 BoundsMin;
+	glm::vec3 BoundsMax;
+	int First;			// leaf : first triangle, inner : index of the right child
+	int Count;			// triangles in the leaf, 0 for inner nodes
+};
+
+struct MeshBVH {
+	std::vector<BVHNode> Nodes;
+	std::vector<glm::vec3> Positions;
+	std::vector<unsigned int> Triangles;	// 3 vertex indices per triangle, in leaf order
+	std::vector<int> TriangleIds;			// original triangle number of each reordered triangle
+};
+
+// Nearest hit along a ray; Distance is the ray parameter t (origin + t * direction)
+struct RayHit {
+	float Distance;
+	int Triangle;
+	float U, V;		// barycentrics of the hit point with respect to the triangle's 2nd and 3rd vertex
+};
+
+void buildMeshBVH(MeshBVH &bvh, const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices);
+// Same from plain arrays; with a scratch arena the build's temporaries come from it
+void buildMeshBVH(MeshBVH &bvh, const glm::vec3 *positions, size_t positionCount, const unsigned int *indices, size_t indexCount, ScratchArena *scratch);
+
+// Returns true and overwrites hit if the mesh is hit closer than hit.Distance
+bool intersectMeshBVH(const MeshBVH &bvh, glm::vec3 origin, glm::vec3 direction, RayHit &hit);
+
+#endif
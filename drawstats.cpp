@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <string.h>
+#include <GL/glew.h>
+
+#include "drawstats.hpp"
+
+void initDrawValidator(DrawValidator &validator, bool validate)
+{
+	memset(&validator, 0, sizeof(validator));
+	validator.Validate = validate;
+}
+
+void endDrawFrame(DrawValidator &validator)
+{
+	validator.Last = validator.Frame;
+	memset(&validator.Frame, 0, sizeof(validator.Frame));
+}
+
+static void countDraw(DrawValidator &validator, GLenum mode, GLsizei count, GLsizei instances)
+{
+	DrawStats &frame = validator.Frame;
+	frame.Draws++;
+	frame.Vertices += (unsigned long long)count * instances;
+	if (mode == GL_TRIANGLES)
+		frame.Triangles += (unsigned long long)(count / 3) * instances;
+	else if (mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN)
+		frame.Triangles += (unsigned long long)(count > 2 ? count - 2 : 0) * instances;
+}
+
+bool checkDrawRange(DrawValidator &validator, const char *name, const char *what, size_t first, size_t count, size_t size)
+{
+	if (first + count <= size)
+		return true;
+
+	validator.Frame.Errors++;
+	if (validator.TotalErrors++ < MaxDrawErrorReports)
+		fprintf(stderr, "ERROR: Draw of %s reads %s [%u, %u) of %u\n", name, what,
+			(unsigned int)first, (unsigned int)(first + count), (unsigned int)size);
+	return false;
+}
+
+// Size of the buffer behind the bound VAO's attribute 0 and its stride, 0 if there is none
+static GLint attributeBufferSize(GLint &stride)
+{
+	GLint buffer = 0, size = 0, components = 0;
+	glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+	glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+	glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_SIZE, &components);
+	if (buffer == 0)
+		return 0;
+
+	// Every position attribute here is float, tightly packed ones report a stride of 0
+	if (stride == 0)
+		stride = components * sizeof(GLfloat);
+
+	// Read through the copy binding so GL_ARRAY_BUFFER is left alone
+	GLint previous = 0;
+	glGetIntegerv(GL_COPY_READ_BUFFER_BINDING, &previous);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+	glBindBuffer(GL_COPY_READ_BUFFER, previous);
+	return size;
+}
+
+bool recordDrawArrays(DrawValidator &validator, const char *name, GLenum mode, GLint first, GLsizei count, GLsizei instances)
+{
+	countDraw(validator, mode, count, instances);
+	if (!validator.Validate)
+		return true;
+
+	GLint stride = 0;
+	const GLint size = attributeBufferSize(stride);
+	return checkDrawRange(validator, name, "vertices", first, count, stride > 0 ? size / stride : 0);
+}
+
+bool recordDrawElements(DrawValidator &validator, const char *name, GLenum mode, GLsizei count, GLenum type, size_t indexOffset, GLsizei instances)
+{
+	countDraw(validator, mode, count, instances);
+	if (!validator.Validate)
+		return true;
+
+	// The element buffer binding belongs to the VAO
+	GLint size = 0;
+	glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+	const size_t indexSize = (type == GL_UNSIGNED_INT) ? 4 : (type == GL_UNSIGNED_SHORT) ? 2 : 1;
+	return checkDrawRange(validator, name, "indices", indexOffset / indexSize, count, size / indexSize);
+}
@@ -0,0 +1,42 @@
+#ifndef DRAWSTATS_HPP
+#define DRAWSTATS_HPP
+
+#include <stddef.h>
+#include <GL/glew.h>
+
+// Geometry submitted per frame, and optional validation of every draw against the buffers
+// bound to the current VAO. Counting is a few additions per draw and always on; the
+// buffer size checks cost a handful of glGet* calls per draw and only run with Validate.
+
+const int MaxDrawErrorReports = 16;		// messages printed before going quiet, errors are still counted
+
+struct DrawStats {
+	unsigned int Submissions;		// API draw calls, a multi-draw counts once
+	unsigned int Draws;				// meshes drawn, every multi-draw command counts
+	unsigned long long Triangles;
+	unsigned long long Vertices;	// vertex shader inputs, indices x instances
+	unsigned int Errors;
+};
+
+struct DrawValidator {
+	bool Validate;
+	DrawStats Frame;				// being accumulated
+	DrawStats Last;					// last complete frame
+	unsigned int TotalErrors;
+};
+
+void initDrawValidator(DrawValidator &validator, bool validate);
+
+// Closes the frame : Frame moves to Last and starts over
+void endDrawFrame(DrawValidator &validator);
+
+// Count one draw from the bound VAO; with Validate the vertex range is checked against
+// the buffer behind attribute 0, the index range against the bound element buffer.
+// Return false (and report) when the draw reads past the end of a buffer.
+bool recordDrawArrays(DrawValidator &validator, const char *name, GLenum mode, GLint first, GLsizei count, GLsizei instances);
+bool recordDrawElements(DrawValidator &validator, const char *name, GLenum mode, GLsizei count, GLenum type, size_t indexOffset, GLsizei instances);
+
+// Reports a draw reading elements [first, first + count) out of size available
+bool checkDrawRange(DrawValidator &validator, const char *name, const char *what, size_t first, size_t count, size_t size);
+
+#endif
@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <GL/glew.h>
+
+#include "frameprofiler.hpp"
+
+static double profilerSeconds(void)
+{
+	typedef std::chrono::steady_clock Clock;
+	return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+}
+
+void initFrameProfiler(FrameProfiler &profiler)
+{
+	profiler.NumTimers = 0;
+	profiler.GpuQueries = false;
+}
+
+static int addTimer(FrameProfiler &profiler, const char *name, bool gpu, bool counter)
+{
+	if (profiler.NumTimers == MaxProfileTimers)
+		return -1;
+
+	ProfileTimer &timer = profiler.Timers[profiler.NumTimers];
+	timer.Name = name;
+	timer.Gpu = gpu;
+	timer.Counter = counter;
+	timer.Count = timer.Next = 0;
+	timer.Start = 0.0;
+	memset(timer.Queries, 0, sizeof(timer.Queries));
+	memset(timer.Pending, 0, sizeof(timer.Pending));
+	timer.NextQuery = 0;
+	timer.Active = false;
+	timer.Summary = "-";
+
+	return profiler.NumTimers++;
+}
+
+int addCpuTimer(FrameProfiler &profiler, const char *name)
+{
+	return addTimer(profiler, name, false, false);
+}
+
+int addGpuTimer(FrameProfiler &profiler, const char *name)
+{
+	return addTimer(profiler, name, true, false);
+}
+
+int addCounter(FrameProfiler &profiler, const char *name)
+{
+	return addTimer(profiler, name, false, true);
+}
+
+void createProfilerQueries(FrameProfiler &profiler)
+{
+	for (int i = 0; i < profiler.NumTimers; i++) {
+		if (profiler.Timers[i].Gpu)
+			glGenQueries(NumProfileQueries, profiler.Timers[i].Queries);
+	}
+	profiler.GpuQueries = true;
+}
+
+void destroyProfilerQueries(FrameProfiler &profiler)
+{
+	for (int i = 0; i < profiler.NumTimers; i++) {
+		ProfileTimer &timer = profiler.Timers[i];
+		if (!timer.Gpu)
+			continue;
+		glDeleteQueries(NumProfileQueries, timer.Queries);
+		memset(timer.Queries, 0, sizeof(timer.Queries));
+		memset(timer.Pending, 0, sizeof(timer.Pending));
+	}
+	profiler.GpuQueries = false;
+}
+
+
+//-- TIMERS --//
+
+void beginCpuTimer(FrameProfiler &profiler, int timer)
+{
+	if (timer >= 0)
+		profiler.Timers[timer].Start = profilerSeconds();
+}
+
+void endCpuTimer(FrameProfiler &profiler, int timer)
+{
+	if (timer >= 0)
+		addProfileSample(profiler.Timers[timer], float((profilerSeconds() - profiler.Timers[timer].Start) * 1000.0));
+}
+
+void beginGpuTimer(FrameProfiler &profiler, int timer)
+{
+	if (timer < 0 || !profiler.GpuQueries)
+		return;
+
+	// Queries are issued and collected in ring order, the pending ones follow NextQuery
+	ProfileTimer &t = profiler.Timers[timer];
+	int pending = 0;
+	while (pending < NumProfileQueries && t.Pending[(t.NextQuery + pending) % NumProfileQueries])
+		pending++;
+
+	t.Active = pending < NumProfileQueries;
+	if (!t.Active)
+		return;
+
+	const int slot = (t.NextQuery + pending) % NumProfileQueries;
+	glBeginQuery(GL_TIME_ELAPSED, t.Queries[slot]);
+	t.Pending[slot] = true;
+}
+
+void endGpuTimer(FrameProfiler &profiler, int timer)
+{
+	if (timer < 0 || !profiler.Timers[timer].Active)
+		return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	profiler.Timers[timer].Active = false;
+}
+
+void collectGpuTimers(FrameProfiler &profiler)
+{
+	if (!profiler.GpuQueries)
+		return;
+
+	for (int i = 0; i < profiler.NumTimers; i++) {
+		ProfileTimer &timer = profiler.Timers[i];
+		if (!timer.Gpu)
+			continue;
+
+		// Oldest first so samples land in submission order
+		for (int n = 0; n < NumProfileQueries; n++) {
+			const int slot = timer.NextQuery;
+			if (!timer.Pending[slot])
+				break;
+
+			GLint available = 0;
+			glGetQueryObjectiv(timer.Queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;
+
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(timer.Queries[slot], GL_QUERY_RESULT, &nanoseconds);
+			addProfileSample(timer, float(nanoseconds / 1.0e6));
+
+			timer.Pending[slot] = false;
+			timer.NextQuery = (slot + 1) % NumProfileQueries;
+		}
+	}
+}
+
+
+void setCounter(FrameProfiler &profiler, int counter, double value)
+{
+	if (counter >= 0)
+		addProfileSample(profiler.Timers[counter], float(value));
+}
+
+
+//-- STATISTICS --//
+
+void addProfileSample(ProfileTimer &timer, float milliseconds)
+{
+	timer.Samples[timer.Next] = milliseconds;
+	timer.Next = (timer.Next + 1) % ProfileWindow;
+	if (timer.Count < ProfileWindow)
+		timer.Count++;
+}
+
+ProfileStats computeProfileStats(const ProfileTimer &timer)
+{
+	ProfileStats stats;
+	stats.Samples = timer.Count;
+	stats.Min = stats.Avg = stats.P99 = stats.Max = 0.0f;
+	if (timer.Count == 0)
+		return stats;
+
+	float sorted[ProfileWindow];
+	double sum = 0.0;
+	for (int i = 0; i < timer.Count; i++) {
+		sorted[i] = timer.Samples[i];
+		sum += sorted[i];
+	}
+	std::sort(sorted, sorted + timer.Count);
+
+	// Nearest-rank percentile
+	const int rank = (99 * timer.Count + 99) / 100;
+	stats.Min = sorted[0];
+	stats.Avg = float(sum / timer.Count);
+	stats.P99 = sorted[rank - 1];
+	stats.Max = sorted[timer.Count - 1];
+	return stats;
+}
+
+void updateProfilerSummaries(FrameProfiler &profiler)
+{
+	for (int i = 0; i < profiler.NumTimers; i++) {
+		const ProfileStats stats = computeProfileStats(profiler.Timers[i]);
+		char summary[64];
+		if (stats.Samples == 0)
+			snprintf(summary, sizeof(summary), "-");
+		else if (profiler.Timers[i].Counter)
+			snprintf(summary, sizeof(summary), "%.0f / %.0f / %.0f", stats.Min, stats.Avg, stats.P99);
+		else
+			snprintf(summary, sizeof(summary), "%.3f / %.3f / %.3f ms", stats.Min, stats.Avg, stats.P99);
+		profiler.Timers[i].Summary = summary;
+	}
+}
+
+
+//-- OUTPUT --//
+
+static const char* timerType(const ProfileTimer &timer)
+{
+	return timer.Counter ? "count" : timer.Gpu ? "gpu" : "cpu";
+}
+
+void printProfileStats(const FrameProfiler &profiler)
+{
+	printf("%-14s %5s %8s %10s %10s %10s %10s\n", "timer", "type", "samples", "min ms", "avg ms", "p99 ms", "max ms");
+	for (int i = 0; i < profiler.NumTimers; i++) {
+		const ProfileTimer &timer = profiler.Timers[i];
+		const ProfileStats stats = computeProfileStats(timer);
+		printf("%-14s %5s %8d %10.3f %10.3f %10.3f %10.3f\n", timer.Name, timerType(timer),
+			stats.Samples, stats.Min, stats.Avg, stats.P99, stats.Max);
+	}
+}
+
+bool writeProfileCSV(const FrameProfiler &profiler, const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "ERROR: Could not write profile %s\n", path);
+		return false;
+	}
+
+	fprintf(file, "timer,type,samples,min_ms,avg_ms,p99_ms,max_ms\n");
+	for (int i = 0; i < profiler.NumTimers; i++) {
+		const ProfileTimer &timer = profiler.Timers[i];
+		const ProfileStats stats = computeProfileStats(timer);
+		fprintf(file, "%s,%s,%d,%.4f,%.4f,%.4f,%.4f\n", timer.Name, timerType(timer),
+			stats.Samples, stats.Min, stats.Avg, stats.P99, stats.Max);
+	}
+	return fclose(file) == 0;
+}
+
+bool writeProfileJSON(const FrameProfiler &profiler, const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "ERROR: Could not write profile %s\n", path);
+		return false;
+	}
+
+	fprintf(file, "{\n  \"timers\": [\n");
+	for (int i = 0; i < profiler.NumTimers; i++) {
+		const ProfileTimer &timer = profiler.Timers[i];
+		const ProfileStats stats = computeProfileStats(timer);
+		// Counter values carry no unit suffix
+		const char *unit = timer.Counter ? "" : "_ms";
+		fprintf(file, "    { \"name\": \"%s\", \"type\": \"%s\", \"samples\": %d, \"min%s\": %.4f, \"avg%s\": %.4f, \"p99%s\": %.4f, \"max%s\": %.4f,\n",
+			timer.Name, timerType(timer), stats.Samples, unit, stats.Min, unit, stats.Avg, unit, stats.P99, unit, stats.Max);
+
+		// Ring buffer unrolled oldest first
+		fprintf(file, "      \"samples%s\": [", unit);
+		const int first = (timer.Count < ProfileWindow) ? 0 : timer.Next;
+		for (int n = 0; n < timer.Count; n++)
+			fprintf(file, n == 0 ? "%.4f" : ", %.4f", timer.Samples[(first + n) % ProfileWindow]);
+		fprintf(file, "] }%s\n", i + 1 < profiler.NumTimers ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+	return fclose(file) == 0;
+}
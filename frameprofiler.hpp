@@ -0,0 +1,89 @@
+#ifndef FRAMEPROFILER_HPP
+#define FRAMEPROFILER_HPP
+
+#include <string>
+#include <GL/glew.h>
+
+// Per-frame CPU and GPU timers with rolling statistics.
+// CPU timers wrap a section of the frame with the steady clock. GPU timers wrap a pass
+// with a GL_TIME_ELAPSED query; results are collected without waiting, a few frames
+// late, from a small ring of queries per timer. GPU timers must not overlap each other.
+// Counters keep one per-frame total (draw calls, triangles, ...) in the same kind of window.
+// Every timer keeps its last ProfileWindow samples for min/avg/p99.
+
+const int MaxProfileTimers = 16;
+const int ProfileWindow = 256;			// samples kept per timer
+const int NumProfileQueries = 4;		// GPU queries in flight per timer
+
+struct ProfileStats {
+	int Samples;
+	float Min, Avg, P99, Max;		// milliseconds
+};
+
+struct ProfileTimer {
+	const char *Name;
+	bool Gpu;
+	bool Counter;					// samples are per-frame totals, not milliseconds
+
+	float Samples[ProfileWindow];	// milliseconds (or counts), ring buffer
+	int Count;						// valid samples, up to ProfileWindow
+	int Next;						// slot the next sample goes to
+
+	double Start;					// CPU : steady clock seconds at begin
+	GLuint Queries[NumProfileQueries];
+	bool Pending[NumProfileQueries];
+	int NextQuery;					// GPU : oldest pending query is at NextQuery
+	bool Active;					// GPU : a query was started by the last begin
+
+	std::string Summary;			// "min / avg / p99 ms", refreshed by updateProfilerSummaries()
+};
+
+struct FrameProfiler {
+	ProfileTimer Timers[MaxProfileTimers];
+	int NumTimers;
+	bool GpuQueries;				// false before createProfilerQueries() or without a context
+};
+
+void initFrameProfiler(FrameProfiler &profiler);
+int addCpuTimer(FrameProfiler &profiler, const char *name);
+int addGpuTimer(FrameProfiler &profiler, const char *name);
+int addCounter(FrameProfiler &profiler, const char *name);
+
+// Needs a current GL context; GPU timers stay empty until this is called
+void createProfilerQueries(FrameProfiler &profiler);
+void destroyProfilerQueries(FrameProfiler &profiler);
+
+void beginCpuTimer(FrameProfiler &profiler, int timer);
+void endCpuTimer(FrameProfiler &profiler, int timer);
+
+// Skips the sample rather than stall if every query of the timer is still in flight
+void beginGpuTimer(FrameProfiler &profiler, int timer);
+void endGpuTimer(FrameProfiler &profiler, int timer);
+
+// Reads back every finished GPU query, never waits
+void collectGpuTimers(FrameProfiler &profiler);
+
+// One sample per frame
+void setCounter(FrameProfiler &profiler, int counter, double value);
+
+// Times the enclosing scope on a CPU timer
+struct ScopedCpuTimer {
+	FrameProfiler &Profiler;
+	int Timer;
+	ScopedCpuTimer(FrameProfiler &profiler, int timer) : Profiler(profiler), Timer(timer) { beginCpuTimer(profiler, timer); }
+	~ScopedCpuTimer(void) { endCpuTimer(Profiler, Timer); }
+};
+
+void addProfileSample(ProfileTimer &timer, float milliseconds);
+ProfileStats computeProfileStats(const ProfileTimer &timer);
+void updateProfilerSummaries(FrameProfiler &profiler);
+
+// Table of every timer's stats on stdout
+void printProfileStats(const FrameProfiler &profiler);
+
+// Stats of every timer; the JSON file also holds the raw sample windows, oldest first.
+// Counters are rows of type "count" whose values are per-frame totals.
+bool writeProfileCSV(const FrameProfiler &profiler, const char *path);
+bool writeProfileJSON(const FrameProfiler &profiler, const char *path);
+
+#endif
@@ -0,0 +1,64 @@
+#include <chrono>
+#include <thread>
+
+#include "framescheduler.hpp"
+
+double schedulerSeconds(void)
+{
+	typedef std::chrono::steady_clock Clock;
+	return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+}
+
+void initFrameScheduler(FrameScheduler &scheduler, double updateRate, double maxFps, bool vsync)
+{
+	scheduler.Step = 1.0 / updateRate;
+	scheduler.Accumulator = 0.0;
+	scheduler.Previous = schedulerSeconds();
+	scheduler.Alpha = 1.0;
+	scheduler.FrameTime = maxFps > 0.0 ? 1.0 / maxFps : 0.0;
+	scheduler.FrameStart = scheduler.Previous;
+	scheduler.VSync = vsync;
+	scheduler.Ticks = 0;
+}
+
+int advanceFrameScheduler(FrameScheduler &scheduler)
+{
+	const double now = schedulerSeconds();
+	scheduler.FrameStart = now;
+	scheduler.Accumulator += now - scheduler.Previous;
+	scheduler.Previous = now;
+
+	int steps = 0;
+	while (scheduler.Accumulator >= scheduler.Step && steps < MaxStepsPerFrame) {
+		scheduler.Accumulator -= scheduler.Step;
+		steps++;
+	}
+	if (steps == MaxStepsPerFrame && scheduler.Accumulator >= scheduler.Step)
+		scheduler.Accumulator = 0.0;
+
+	scheduler.Ticks += steps;
+	scheduler.Alpha = scheduler.Accumulator / scheduler.Step;
+	return steps;
+}
+
+void resetFrameScheduler(FrameScheduler &scheduler)
+{
+	scheduler.Previous = schedulerSeconds();
+	scheduler.Accumulator = 0.0;
+}
+
+void paceFrame(FrameScheduler &scheduler)
+{
+	if (scheduler.FrameTime <= 0.0)
+		return;
+
+	// The OS may oversleep by a millisecond or so : sleep short, then yield up to the deadline.
+	// With vsync the swap does the final wait, so stop sleeping a little early.
+	const double SleepMargin = 0.001;
+	const double deadline = scheduler.FrameStart + scheduler.FrameTime - (scheduler.VSync ? SleepMargin : 0.0);
+	const double remaining = deadline - schedulerSeconds();
+	if (remaining > SleepMargin)
+		std::this_thread::sleep_for(std::chrono::duration<double>(remaining - SleepMargin));
+	while (!scheduler.VSync && schedulerSeconds() < deadline)
+		std::this_thread::yield();
+}
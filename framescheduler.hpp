@@ -0,0 +1,40 @@
+#ifndef FRAMESCHEDULER_HPP
+#define FRAMESCHEDULER_HPP
+
+// Fixed-timestep simulation with interpolated rendering and optional frame pacing.
+// Each frame, advanceFrameScheduler() adds the elapsed time to an accumulator and says how
+// many fixed updates of Step seconds to run; Alpha is how far the frame lies between the
+// last two simulation states. Motion therefore runs at the same speed at any frame rate
+// and the same number of ticks always produces the same state.
+// With a frame cap, paceFrame() sleeps away the rest of the frame instead of spinning.
+
+const int MaxStepsPerFrame = 8;		// after a stall, drop time rather than run ever more updates
+
+struct FrameScheduler {
+	double Step;				// seconds per fixed update
+	double Accumulator;			// simulation time owed
+	double Previous;			// clock at the last advance
+	double Alpha;				// render position between the last two states, 0..1
+
+	double FrameTime;			// seconds per frame with a cap, 0 when uncapped
+	double FrameStart;
+	bool VSync;					// swap blocks on the display, pacing leaves it the last millisecond
+
+	unsigned long long Ticks;	// fixed updates run so far
+};
+
+double schedulerSeconds(void);
+
+// updateRate in updates per second; maxFps 0 leaves the frame rate to the swap
+void initFrameScheduler(FrameScheduler &scheduler, double updateRate, double maxFps, bool vsync);
+
+// Number of fixed updates to run this frame, sets Alpha for rendering after them
+int advanceFrameScheduler(FrameScheduler &scheduler);
+
+// Forgets the time since the last advance, after the loop slept on purpose
+void resetFrameScheduler(FrameScheduler &scheduler);
+
+// Sleeps until the capped frame is due, returns immediately when uncapped
+void paceFrame(FrameScheduler &scheduler);
+
+#endif
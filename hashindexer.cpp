@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include <common/objloader.hpp>
+#include <common/vboindexer.hpp>
+
+#include "hashindexer.hpp"
+
+// Position + normal as six 32-bit words : raw float bits, or grid cells when welding
+struct WeldKey {
+	unsigned int Words[6];
+};
+
+static inline WeldKey makeWeldKey(const glm::vec3 &position, const glm::vec3 &normal, float invEpsilon)
+{
+	WeldKey key;
+	if (invEpsilon == 0.0f) {
+		memcpy(&key.Words[0], &position.x, sizeof(float) * 3);
+		memcpy(&key.Words[3], &normal.x, sizeof(float) * 3);
+	}
+	else {
+		for (int i = 0; i < 3; i++) {
+			key.Words[i] = (unsigned int)(int)floorf(position[i] * invEpsilon + 0.5f);
+			key.Words[3 + i] = (unsigned int)(int)floorf(normal[i] * invEpsilon + 0.5f);
+		}
+	}
+	return key;
+}
+
+// MurmurHash3 body and finalizer over the six key words
+static inline unsigned int hashWeldKey(const WeldKey &key)
+{
+	unsigned int h = 0x9747b28cu;
+	for (int i = 0; i < 6; i++) {
+		unsigned int k = key.Words[i] * 0xcc9e2d51u;
+		k = (k << 15) | (k >> 17);
+		h ^= k * 0x1b873593u;
+		h = ((h << 13) | (h >> 19)) * 5 + 0xe6546b64u;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+// Indexes count corners into the output arrays, which have room for count entries each,
+// and returns the number of unique vertices. slotIndex and slotHash hold capacity entries
+// (a power of two at least twice count), keys holds count when welding.
+static size_t indexCorners(const glm::vec3 *in_vertices, const glm::vec3 *in_normals, size_t count, float invEpsilon,
+	unsigned int *out_indices, unsigned int base, glm::vec3 *out_vertices, glm::vec3 *out_normals,
+	unsigned int *slotIndex, unsigned int *slotHash, size_t capacity, WeldKey *keys)
+{
+	// A slot holds (output index + 1), 0 is empty, plus the full hash so most mismatches
+	// never touch the vertex data
+	const size_t mask = capacity - 1;
+	memset(slotIndex, 0, sizeof(unsigned int) * capacity);
+
+	size_t unique = 0;
+	for (size_t i = 0; i < count; i++) {
+		const WeldKey key = makeWeldKey(in_vertices[i], in_normals[i], invEpsilon);
+		const unsigned int hash = hashWeldKey(key);
+
+		size_t slot = hash & mask;
+		unsigned int found = 0;
+		while (slotIndex[slot] != 0) {
+			if (slotHash[slot] == hash) {
+				const unsigned int candidate = slotIndex[slot] - 1;
+				const bool same = (invEpsilon == 0.0f)
+					? memcmp(&out_vertices[candidate].x, &key.Words[0], sizeof(float) * 3) == 0 &&
+					  memcmp(&out_normals[candidate].x, &key.Words[3], sizeof(float) * 3) == 0
+					: memcmp(&keys[candidate], &key, sizeof(WeldKey)) == 0;
+				if (same) {
+					found = slotIndex[slot];
+					break;
+				}
+			}
+			slot = (slot + 1) & mask;
+		}
+
+		if (found == 0) {
+			out_vertices[unique] = in_vertices[i];
+			out_normals[unique] = in_normals[i];
+			if (invEpsilon != 0.0f)
+				keys[unique] = key;
+			found = (unsigned int)++unique;
+			slotIndex[slot] = found;
+			slotHash[slot] = hash;
+		}
+		out_indices[i] = base + found - 1;
+	}
+	return unique;
+}
+
+// Power of two table at most half full
+static size_t tableCapacity(size_t count)
+{
+	size_t capacity = 16;
+	while (capacity < count * 2)
+		capacity *= 2;
+	return capacity;
+}
+
+void indexVBOHashed(const std::vector<glm::vec3> &in_vertices, const std::vector<glm::vec3> &in_normals,
+	std::vector<unsigned int> &out_indices, std::vector<glm::vec3> &out_vertices, std::vector<glm::vec3> &out_normals,
+	float weldEpsilon)
+{
+	const size_t count = in_vertices.size();
+	if (count == 0)
+		return;
+	const float invEpsilon = weldEpsilon > 0.0f ? 1.0f / weldEpsilon : 0.0f;
+
+	// Worst case every vertex is unique, sized for it and trimmed afterwards
+	const size_t indexBase = out_indices.size();
+	const size_t base = out_vertices.size();
+	out_indices.resize(indexBase + count);
+	out_vertices.resize(base + count);
+	out_normals.resize(base + count);
+
+	const size_t capacity = tableCapacity(count);
+	std::vector<unsigned int> slotIndex(capacity);
+	std::vector<unsigned int> slotHash(capacity);
+
+	// Welded vertices compare by grid cell, so the cell of each output vertex is kept
+	std::vector<WeldKey> keys;
+	if (invEpsilon != 0.0f)
+		keys.resize(count);
+
+	const size_t unique = indexCorners(&in_vertices[0], &in_normals[0], count, invEpsilon,
+		&out_indices[indexBase], (unsigned int)base, &out_vertices[base], &out_normals[base],
+		&slotIndex[0], &slotHash[0], capacity, keys.empty() ? NULL : &keys[0]);
+	out_vertices.resize(base + unique);
+	out_normals.resize(base + unique);
+}
+
+size_t indexVerticesHashed(const glm::vec3 *in_vertices, const glm::vec3 *in_normals, size_t count,
+	unsigned int *out_indices, glm::vec3 *out_vertices, glm::vec3 *out_normals, ScratchArena &arena)
+{
+	const size_t capacity = tableCapacity(count);
+	unsigned int *slotIndex = scratchArray<unsigned int>(arena, capacity);
+	unsigned int *slotHash = scratchArray<unsigned int>(arena, capacity);
+	return indexCorners(in_vertices, in_normals, count, 0.0f, out_indices, 0, out_vertices, out_normals,
+		slotIndex, slotHash, capacity, NULL);
+}
+
+
+//-- VERIFICATION AND BENCHMARK --//
+
+bool benchmarkIndexer(void)
+{
+	typedef std::chrono::steady_clock Clock;
+	const char* files[] = { "models/base.obj", "models/arm1.obj", "models/arm2.obj", "models/button.obj",
+							"models/joint.obj", "models/pen.obj", "models/top.obj" };
+	bool passed = true;
+
+	printf("Indexer check : indexVBOHashed vs. indexVBO\n");
+	for (int f = 0; f < 7; f++) {
+		std::vector<glm::vec3> vertices, normals;
+		if (!loadOBJ(files[f], vertices, normals)) {
+			passed = false;
+			continue;
+		}
+
+		std::vector<unsigned short> refIndices;
+		std::vector<glm::vec3> refVertices, refNormals;
+		indexVBO(vertices, normals, refIndices, refVertices, refNormals);
+
+		std::vector<unsigned int> indices;
+		std::vector<glm::vec3> outVertices, outNormals;
+		indexVBOHashed(vertices, normals, indices, outVertices, outNormals);
+
+		bool same = indices.size() == refIndices.size() && outVertices.size() == refVertices.size();
+		for (size_t i = 0; same && i < indices.size(); i++)
+			same = indices[i] == refIndices[i];
+		for (size_t i = 0; same && i < outVertices.size(); i++)
+			same = outVertices[i] == refVertices[i] && outNormals[i] == refNormals[i];
+
+		printf("  %-20s %6u -> %5u vertices  %s\n", files[f], (unsigned int)vertices.size(), (unsigned int)outVertices.size(), same ? "identical" : "MISMATCH");
+		passed = passed && same;
+	}
+
+	// Triangle soup of a flat grid : 1M triangles, 3M input vertices, ~500k unique
+	const int Side = 708;
+	std::vector<glm::vec3> vertices, normals;
+	vertices.reserve(size_t(Side) * Side * 6);
+	for (int z = 0; z < Side; z++) {
+		for (int x = 0; x < Side; x++) {
+			const glm::vec3 a(x, 0, z), b(x + 1, 0, z), c(x + 1, 0, z + 1), d(x, 0, z + 1);
+			const glm::vec3 quad[6] = { a, c, b, a, d, c };
+			for (int k = 0; k < 6; k++)
+				vertices.push_back(quad[k]);
+		}
+	}
+	normals.assign(vertices.size(), glm::vec3(0.0f, 1.0f, 0.0f));
+	const double triangles = double(vertices.size() / 3);
+
+	printf("Indexer throughput : %.0f triangles, %u input vertices\n", triangles, (unsigned int)vertices.size());
+
+	Clock::time_point start = Clock::now();
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> outVertices, outNormals;
+	indexVBOHashed(vertices, normals, indices, outVertices, outNormals);
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	printf("  %-14s %9.1f ms %12.0f triangles/s  %u unique\n", "hashed", seconds * 1000.0, triangles / seconds, (unsigned int)outVertices.size());
+
+	start = Clock::now();
+	indices.clear(); outVertices.clear(); outNormals.clear();
+	indexVBOHashed(vertices, normals, indices, outVertices, outNormals, 1e-4f);
+	seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	printf("  %-14s %9.1f ms %12.0f triangles/s  %u unique\n", "hashed+weld", seconds * 1000.0, triangles / seconds, (unsigned int)outVertices.size());
+
+	// indexVBO's 16-bit indices wrap on a mesh this size, only its run time is meaningful
+	start = Clock::now();
+	std::vector<unsigned short> refIndices;
+	std::vector<glm::vec3> refVertices, refNormals;
+	indexVBO(vertices, normals, refIndices, refVertices, refNormals);
+	seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	printf("  %-14s %9.1f ms %12.0f triangles/s  %u unique\n", "indexVBO", seconds * 1000.0, triangles / seconds, (unsigned int)refVertices.size());
+
+	printf(passed ? "Indexer check passed\n" : "Indexer check FAILED\n");
+	return passed;
+}
@@ -0,0 +1,29 @@
+#ifndef HASHINDEXER_HPP
+#define HASHINDEXER_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "scratcharena.hpp"
+
+// Drop-in replacement for indexVBO() : welds duplicate position+normal pairs through an
+// open-addressing hash table instead of a std::map, so indexing stays linear in the
+// number of input vertices. First occurrences keep their order, so with weldEpsilon 0
+// the output is identical to indexVBO().
+//
+// With weldEpsilon > 0 positions and normals are quantized to an epsilon grid first and
+// every vertex falling into an occupied grid cell is welded to that cell's first vertex.
+void indexVBOHashed(const std::vector<glm::vec3> &in_vertices, const std::vector<glm::vec3> &in_normals,
+	std::vector<unsigned int> &out_indices, std::vector<glm::vec3> &out_vertices, std::vector<glm::vec3> &out_normals,
+	float weldEpsilon = 0.0f);
+
+// The same indexing (without welding) on plain arrays, for loads that keep every temporary
+// in a scratch arena. The outputs need room for count entries; returns the unique vertices.
+size_t indexVerticesHashed(const glm::vec3 *in_vertices, const glm::vec3 *in_normals, size_t count,
+	unsigned int *out_indices, glm::vec3 *out_vertices, glm::vec3 *out_normals, ScratchArena &arena);
+
+// Checks indexVBOHashed() against indexVBO() on the bundled models, then measures both on
+// a synthetic 1M triangle mesh. Returns false if any model indexes differently.
+bool benchmarkIndexer(void);
+
+#endif
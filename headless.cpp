@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <GL/glew.h>
+
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "headless.hpp"
+
+#ifdef _WIN32
+
+bool createHeadlessContext(HeadlessContext &headless, int width, int height)
+{
+	memset(&headless, 0, sizeof(headless));
+	fprintf(stderr, "ERROR: Headless rendering needs EGL, it is not available on this platform\n");
+	return false;
+}
+
+void destroyHeadlessContext(HeadlessContext &headless)
+{
+}
+
+#else
+
+static EGLDisplay getHeadlessDisplay(void)
+{
+	EGLDisplay display = EGL_NO_DISPLAY;
+
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+	// Surfaceless platform : no window system and no DRM device required
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay != NULL)
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	return display;
+}
+
+bool createHeadlessContext(HeadlessContext &headless, int width, int height)
+{
+	memset(&headless, 0, sizeof(headless));
+	headless.Width = width;
+	headless.Height = height;
+
+	EGLDisplay display = getHeadlessDisplay();
+	EGLint major = 0, minor = 0;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		fprintf(stderr, "ERROR: Could not initialize an EGL display\n");
+		return false;
+	}
+	headless.Display = display;
+
+	const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+	if (extensions == NULL || strstr(extensions, "EGL_KHR_surfaceless_context") == NULL) {
+		fprintf(stderr, "ERROR: EGL %d.%d has no EGL_KHR_surfaceless_context\n", major, minor);
+		destroyHeadlessContext(headless);
+		return false;
+	}
+
+	// Desktop GL, the shaders are #version 330 core
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+		EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+		EGL_NONE
+	};
+
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+		fprintf(stderr, "ERROR: No EGL config for desktop OpenGL\n");
+		destroyHeadlessContext(headless);
+		return false;
+	}
+
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		fprintf(stderr, "ERROR: Could not create an OpenGL 3.3 core context (EGL error 0x%x)\n", eglGetError());
+		if (context != EGL_NO_CONTEXT)
+			eglDestroyContext(display, context);
+		destroyHeadlessContext(headless);
+		return false;
+	}
+	headless.Context = context;
+
+	// GLEW built for GLX still resolves the core entry points, it only fails to find a GLX display
+	glewExperimental = true;
+	const GLenum glewStatus = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	if (glewStatus != GLEW_OK && glewStatus != GLEW_ERROR_NO_GLX_DISPLAY) {
+#else
+	if (glewStatus != GLEW_OK) {
+#endif
+		fprintf(stderr, "Failed to initialize GLEW\n");
+		destroyHeadlessContext(headless);
+		return false;
+	}
+	// GLEW probes with legacy calls that raise errors in a core context
+	while (glGetError() != GL_NO_ERROR) {}
+
+	glGenRenderbuffers(1, &headless.ColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, headless.ColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &headless.DepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, headless.DepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &headless.Framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, headless.Framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headless.ColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, headless.DepthBuffer);
+	const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "ERROR: Headless framebuffer is incomplete (0x%x)\n", status);
+		destroyHeadlessContext(headless);
+		return false;
+	}
+
+	// Without a surface the viewport starts out empty
+	glViewport(0, 0, width, height);
+	return true;
+}
+
+void destroyHeadlessContext(HeadlessContext &headless)
+{
+	if (headless.Context != NULL) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &headless.Framebuffer);
+		glDeleteRenderbuffers(1, &headless.ColorBuffer);
+		glDeleteRenderbuffers(1, &headless.DepthBuffer);
+		eglMakeCurrent((EGLDisplay)headless.Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext((EGLDisplay)headless.Display, (EGLContext)headless.Context);
+	}
+	if (headless.Display != NULL)
+		eglTerminate((EGLDisplay)headless.Display);
+	memset(&headless, 0, sizeof(headless));
+}
+
+#endif
+
+const char* headlessRenderer(void)
+{
+	const GLubyte *renderer = glGetString(GL_RENDERER);
+	return renderer != NULL ? (const char*)renderer : "unknown";
+}
+
+bool writeFramebufferPPM(const char *path, int width, int height)
+{
+	std::vector<unsigned char> pixels(size_t(width) * height * 3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "ERROR: Could not write image %s\n", path);
+		return false;
+	}
+
+	// OpenGL rows start at the bottom, PPM rows at the top
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	bool ok = true;
+	for (int y = height - 1; ok && y >= 0; y--)
+		ok = fwrite(&pixels[size_t(y) * width * 3], 3, width, file) == size_t(width);
+	ok = (fclose(file) == 0) && ok;
+	return ok;
+}
@@ -0,0 +1,30 @@
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+
+#include <GL/glew.h>
+
+// Offscreen OpenGL 3.3 core context for machines without a display.
+// The context is created through EGL with no surface at all (EGL_KHR_surfaceless_context),
+// preferring Mesa's surfaceless platform so neither an X server nor a GPU is needed;
+// llvmpipe renders when no hardware driver is present. Everything is drawn into a
+// framebuffer object that stays bound in place of the window's default framebuffer.
+struct HeadlessContext {
+	void *Display;		// EGLDisplay
+	void *Context;		// EGLContext
+	GLuint Framebuffer;
+	GLuint ColorBuffer;
+	GLuint DepthBuffer;
+	int Width, Height;
+};
+
+// Creates the context, initializes GLEW and binds a width x height RGBA8 + depth framebuffer
+bool createHeadlessContext(HeadlessContext &headless, int width, int height);
+void destroyHeadlessContext(HeadlessContext &headless);
+
+// Name of the renderer behind the context, e.g. "llvmpipe (LLVM 15.0.7, 256 bits)"
+const char* headlessRenderer(void);
+
+// Reads the bound framebuffer back and writes it as a binary PPM, top row first
+bool writeFramebufferPPM(const char *path, int width, int height);
+
+#endif
@@ -0,0 +1,153 @@
+#include <string.h>
+
+#include "inputqueue.hpp"
+#include "framescheduler.hpp"
+
+static InputCommand newCommand(InputQueue &queue, InputCommandType type)
+{
+	InputCommand command;
+	memset(&command, 0, sizeof(command));
+	command.Time = schedulerSeconds() - queue.Start;
+	command.Type = (unsigned char)type;
+	return command;
+}
+
+void initInputQueue(InputQueue &queue)
+{
+	queue.Pending.clear();
+	queue.Drained.clear();
+	queue.Start = schedulerSeconds();
+	queue.Record = NULL;
+	queue.Replay.clear();
+	queue.ReplayNext = 0;
+	queue.Pushed = 0;
+	queue.Coalesced = 0;
+	queue.Recorded = 0;
+}
+
+void pushKeyCommand(InputQueue &queue, int key, bool pressed)
+{
+	if (inputReplayActive(queue))
+		return;
+	InputCommand command = newCommand(queue, KeyCommand);
+	command.Key = (unsigned short)key;
+	command.Pressed = pressed ? 1 : 0;
+	queue.Pending.push_back(command);
+	queue.Pushed++;
+}
+
+void pushPointerCommand(InputQueue &queue, InputCommandType type, double x, double y)
+{
+	if (inputReplayActive(queue))
+		return;
+	InputCommand command = newCommand(queue, type);
+	command.X = float(x);
+	command.Y = float(y);
+	queue.Pending.push_back(command);
+	queue.Pushed++;
+}
+
+const std::vector<InputCommand> &drainInputQueue(InputQueue &queue, unsigned int tick)
+{
+	queue.Drained.clear();
+
+	if (inputReplayActive(queue)) {
+		queue.Pending.clear();
+		while (queue.ReplayNext < queue.Replay.size() && queue.Replay[queue.ReplayNext].Tick <= tick)
+			queue.Drained.push_back(queue.Replay[queue.ReplayNext++]);
+		return queue.Drained;
+	}
+
+	// Keys all count, of the picks and hovers only the last one of the frame does
+	size_t lastPick = queue.Pending.size(), lastHover = queue.Pending.size();
+	for (size_t i = 0; i < queue.Pending.size(); i++) {
+		if (queue.Pending[i].Type == PickCommand)
+			lastPick = i;
+		else if (queue.Pending[i].Type == HoverCommand)
+			lastHover = i;
+	}
+	for (size_t i = 0; i < queue.Pending.size(); i++) {
+		const InputCommand &command = queue.Pending[i];
+		if ((command.Type == PickCommand && i != lastPick) || (command.Type == HoverCommand && i != lastHover)) {
+			queue.Coalesced++;
+			continue;
+		}
+		queue.Drained.push_back(command);
+		queue.Drained.back().Tick = tick;
+	}
+	queue.Pending.clear();
+
+	if (queue.Record != NULL && !queue.Drained.empty()) {
+		if (fwrite(&queue.Drained[0], sizeof(InputCommand), queue.Drained.size(), queue.Record) == queue.Drained.size())
+			queue.Recorded += (unsigned int)queue.Drained.size();
+		else {
+			fprintf(stderr, "ERROR: Can't write the input log, recording stopped\n");
+			stopInputRecording(queue);
+		}
+	}
+	return queue.Drained;
+}
+
+bool startInputRecording(InputQueue &queue, const char *path)
+{
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "ERROR: Can't create %s\n", path);
+		return false;
+	}
+
+	InputLogHeader header;
+	memcpy(header.Magic, INPUT_LOG_MAGIC, 4);
+	header.Version = InputLogVersion;
+	header.RecordSize = sizeof(InputCommand);
+	if (fwrite(&header, sizeof(header), 1, file) != 1) {
+		fclose(file);
+		return false;
+	}
+	queue.Record = file;
+	queue.Recorded = 0;
+	return true;
+}
+
+void stopInputRecording(InputQueue &queue)
+{
+	if (queue.Record == NULL)
+		return;
+	fclose(queue.Record);
+	queue.Record = NULL;
+}
+
+bool loadInputReplay(InputQueue &queue, const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "ERROR: Can't open %s\n", path);
+		return false;
+	}
+
+	InputLogHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.Magic, INPUT_LOG_MAGIC, 4) != 0 ||
+		header.Version != InputLogVersion || header.RecordSize != sizeof(InputCommand)) {
+		fprintf(stderr, "ERROR: %s is not an input log of this version\n", path);
+		fclose(file);
+		return false;
+	}
+
+	queue.Replay.clear();
+	InputCommand command;
+	while (fread(&command, sizeof(command), 1, file) == 1)
+		queue.Replay.push_back(command);
+	fclose(file);
+	queue.ReplayNext = 0;
+	return true;
+}
+
+bool inputReplayActive(const InputQueue &queue)
+{
+	return queue.ReplayNext < queue.Replay.size();
+}
+
+unsigned int inputReplayTicks(const InputQueue &queue)
+{
+	return queue.Replay.empty() ? 0 : queue.Replay.back().Tick + 1;
+}
@@ -0,0 +1,74 @@
+#ifndef INPUTQUEUE_HPP
+#define INPUTQUEUE_HPP
+
+#include <stdio.h>
+#include <vector>
+
+// Timestamped input commands.
+// The GLFW callbacks only push commands; the main loop drains the queue once per frame and
+// applies them between frames. Picks and hovers are coalesced on the way out : only the
+// last of each in a frame survives, so a burst of clicks costs one picking pass.
+// Drained commands can be appended to a binary log, and a log can be replayed instead of
+// live input. Each command carries the fixed update tick it was applied at and is replayed
+// at the same tick, so a replay moves the rig the same way at any frame rate (exactly so
+// with one update per frame, as in --headless; interactively to within a frame).
+
+enum InputCommandType {
+	KeyCommand,			// Key pressed or released
+	PickCommand,		// left click at X, Y
+	HoverCommand		// cursor moved to X, Y
+};
+
+#define INPUT_LOG_MAGIC "RINP"
+const unsigned int InputLogVersion = 1;
+
+struct InputLogHeader {
+	char Magic[4];
+	unsigned int Version;
+	unsigned int RecordSize;	// sizeof(InputCommand), the records follow until the end of the file
+};
+
+// Also the record layout of the log, 24 bytes
+struct InputCommand {
+	double Time;				// seconds since the queue was started
+	unsigned int Tick;			// fixed updates run when the command was applied
+	unsigned char Type;			// InputCommandType
+	unsigned char Pressed;		// KeyCommand : 1 press, 0 release
+	unsigned short Key;			// GLFW key code
+	float X, Y;					// window coordinates, (0,0) on top
+};
+
+struct InputQueue {
+	std::vector<InputCommand> Pending;		// pushed since the last drain
+	std::vector<InputCommand> Drained;		// handed out by the last drain
+	double Start;
+
+	FILE *Record;							// NULL when not recording
+	std::vector<InputCommand> Replay;
+	size_t ReplayNext;						// Replay.size() when not replaying
+
+	unsigned int Pushed;
+	unsigned int Coalesced;					// picks and hovers dropped for a later one
+	unsigned int Recorded;
+};
+
+void initInputQueue(InputQueue &queue);
+
+// Called from the GLFW callbacks; ignored while a replay is running
+void pushKeyCommand(InputQueue &queue, int key, bool pressed);
+void pushPointerCommand(InputQueue &queue, InputCommandType type, double x, double y);
+
+// Commands to apply before the updates of this frame, valid until the next drain.
+// Replays hand out the logged commands up to tick, otherwise the coalesced live ones,
+// which are written to the log when recording.
+const std::vector<InputCommand> &drainInputQueue(InputQueue &queue, unsigned int tick);
+
+bool startInputRecording(InputQueue &queue, const char *path);
+void stopInputRecording(InputQueue &queue);
+
+bool loadInputReplay(InputQueue &queue, const char *path);
+bool inputReplayActive(const InputQueue &queue);
+// One past the tick of the last logged command, 0 without a replay
+unsigned int inputReplayTicks(const InputQueue &queue);
+
+#endif
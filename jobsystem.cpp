@@ -0,0 +1,144 @@
+#include "jobsystem.hpp"
+
+// Deque of the running thread; threads that aren't part of a system use 0
+static thread_local int tJobThread = 0;
+
+// Idle rounds a worker spins through before it goes to sleep, frames come in quick succession
+static const int JobSpinRounds = 64;
+
+static bool takeJob(JobSystem &system, int self, Job &job)
+{
+	{
+		JobDeque &own = system.Deques[self];
+		std::lock_guard<std::mutex> lock(own.Mutex);
+		if (!own.Jobs.empty()) {
+			job = own.Jobs.back();
+			own.Jobs.pop_back();
+			system.Queued--;
+			return true;
+		}
+	}
+
+	for (int i = 1; i < system.Threads; i++) {
+		JobDeque &victim = system.Deques[(self + i) % system.Threads];
+		std::lock_guard<std::mutex> lock(victim.Mutex);
+		if (!victim.Jobs.empty()) {
+			job = victim.Jobs.front();
+			victim.Jobs.pop_front();
+			system.Queued--;
+			system.Stolen++;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void runJob(JobSystem &system, const Job &job)
+{
+	job.Function(job.Data, job.First, job.Last);
+	system.Executed++;
+	job.Pending->fetch_sub(1);
+}
+
+static void jobWorker(JobSystem *system, int index)
+{
+	tJobThread = index;
+
+	int idle = 0;
+	while (!system->Quit) {
+		Job job;
+		if (takeJob(*system, index, job)) {
+			runJob(*system, job);
+			idle = 0;
+			continue;
+		}
+		if (++idle < JobSpinRounds) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(system->SleepMutex);
+		while (!system->Quit && system->Queued == 0)
+			system->WorkReady.wait(lock);
+		idle = 0;
+	}
+}
+
+void startJobSystem(JobSystem &system, int threads)
+{
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 1;
+
+	system.Threads = threads;
+	system.Deques = new JobDeque[threads];
+	system.Quit = false;
+	system.Queued = 0;
+	system.Executed = 0;
+	system.Stolen = 0;
+	tJobThread = 0;
+	for (int i = 1; i < threads; i++)
+		system.Workers.push_back(std::thread(jobWorker, &system, i));
+}
+
+void stopJobSystem(JobSystem &system)
+{
+	if (system.Deques == NULL)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(system.SleepMutex);
+		system.Quit = true;
+	}
+	system.WorkReady.notify_all();
+	for (size_t i = 0; i < system.Workers.size(); i++)
+		system.Workers[i].join();
+	system.Workers.clear();
+
+	delete[] system.Deques;
+	system.Deques = NULL;
+	system.Threads = 0;
+}
+
+void parallelFor(JobSystem &system, JobFunction function, void *data, int count, int chunk)
+{
+	if (count <= 0)
+		return;
+	const int chunks = (count + chunk - 1) / chunk;
+	if (system.Threads <= 1 || chunks == 1) {
+		function(data, 0, count);
+		return;
+	}
+
+	const int self = tJobThread;
+	std::atomic<int> pending(chunks);
+	{
+		JobDeque &own = system.Deques[self];
+		std::lock_guard<std::mutex> lock(own.Mutex);
+		for (int c = 0; c < chunks; c++) {
+			Job job;
+			job.Function = function;
+			job.Data = data;
+			job.First = c * chunk;
+			job.Last = job.First + chunk < count ? job.First + chunk : count;
+			job.Pending = &pending;
+			own.Jobs.push_back(job);
+		}
+	}
+	system.Queued += chunks;
+	{
+		// Taken after Queued is raised, so a worker deciding to sleep either sees the jobs or gets the notify
+		std::lock_guard<std::mutex> lock(system.SleepMutex);
+	}
+	system.WorkReady.notify_all();
+
+	// Barrier : work, own chunks first, until every chunk has finished wherever it ran
+	while (pending > 0) {
+		Job job;
+		if (takeJob(system, self, job))
+			runJob(system, job);
+		else
+			std::this_thread::yield();
+	}
+}
@@ -0,0 +1,58 @@
+#ifndef JOBSYSTEM_HPP
+#define JOBSYSTEM_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fork-join job system for data-parallel frame work.
+// Every thread owns a deque : it pushes and pops its own jobs at the back, newest first while
+// they are still in cache, and an idle thread steals the oldest job from the front of another
+// one. parallelFor() splits a range into chunk jobs on the caller's deque and the caller works
+// too, stealing once its own jobs are gone, until every chunk is done; that wait is the barrier
+// between the parallel update and whatever reads its results.
+// Workers sleep on a condition variable when no deque holds a job.
+
+typedef void (*JobFunction)(void *data, int first, int last);
+
+struct Job {
+	JobFunction Function;
+	void *Data;
+	int First, Last;
+	std::atomic<int> *Pending;		// chunks of the parallelFor() still to finish
+};
+
+struct JobDeque {
+	std::mutex Mutex;
+	std::deque<Job> Jobs;
+};
+
+struct JobSystem {
+	int Threads;					// workers plus the thread that started the system
+	JobDeque *Deques;				// one per thread, 0 belongs to the starting thread
+	std::vector<std::thread> Workers;
+
+	std::atomic<bool> Quit;
+	std::atomic<int> Queued;		// jobs waiting in any deque
+	std::mutex SleepMutex;
+	std::condition_variable WorkReady;
+
+	std::atomic<unsigned int> Executed;
+	std::atomic<unsigned int> Stolen;	// jobs run by a thread other than the one that queued them
+
+	JobSystem(void) : Threads(0), Deques(NULL) {}
+};
+
+// threads 0 uses every hardware thread; 1 runs every job on the caller
+void startJobSystem(JobSystem &system, int threads);
+void stopJobSystem(JobSystem &system);
+
+// Runs function over [0, count) in chunks of chunk, returns once all of them are done.
+// Chunks start on multiples of chunk. Callable from inside a job, the nested range then
+// goes on that thread's deque.
+void parallelFor(JobSystem &system, JobFunction function, void *data, int count, int chunk);
+
+#endif
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "meshcache.hpp"
+
+bool writeMeshCache(const char *path, const void *vertices, unsigned int vertexStride, unsigned int vertexCount,
+	const void *indices, unsigned int indexSize, unsigned int indexCount)
+{
+	MeshCacheHeader header;
+	memcpy(header.Magic, MESH_CACHE_MAGIC, 4);
+	header.Version = MeshCacheVersion;
+	header.VertexStride = vertexStride;
+	header.VertexCount = vertexCount;
+	header.IndexSize = indexSize;
+	header.IndexCount = indexCount;
+	header.VertexOffset = sizeof(MeshCacheHeader);
+	// Keep the index buffer 4-byte aligned inside the mapping
+	header.IndexOffset = (header.VertexOffset + vertexStride * vertexCount + 3) & ~3u;
+
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "ERROR: Could not write mesh cache %s\n", path);
+		return false;
+	}
+
+	const char padding[4] = { 0, 0, 0, 0 };
+	const size_t paddingSize = header.IndexOffset - (header.VertexOffset + vertexStride * vertexCount);
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && fwrite(vertices, vertexStride, vertexCount, file) == vertexCount;
+	ok = ok && fwrite(padding, 1, paddingSize, file) == paddingSize;
+	ok = ok && fwrite(indices, indexSize, indexCount, file) == indexCount;
+	ok = (fclose(file) == 0) && ok;
+
+	if (!ok) {
+		fprintf(stderr, "ERROR: Could not write mesh cache %s\n", path);
+		remove(path);
+	}
+	return ok;
+}
+
+static bool validateMeshCache(const MappedMeshCache &cache, unsigned int vertexStride)
+{
+	if (cache.MappingSize < sizeof(MeshCacheHeader))
+		return false;
+
+	const MeshCacheHeader &header = *cache.Header;
+	if (memcmp(header.Magic, MESH_CACHE_MAGIC, 4) != 0 || header.Version != MeshCacheVersion)
+		return false;
+	if (header.VertexStride != vertexStride || (header.IndexSize != 2 && header.IndexSize != 4))
+		return false;
+
+	// 64-bit sums so corrupt counts can't wrap around the size checks
+	const unsigned long long vertexEnd = (unsigned long long)header.VertexOffset + (unsigned long long)header.VertexStride * header.VertexCount;
+	const unsigned long long indexEnd = (unsigned long long)header.IndexOffset + (unsigned long long)header.IndexSize * header.IndexCount;
+	return vertexEnd <= cache.MappingSize && indexEnd <= cache.MappingSize;
+}
+
+bool mapMeshCache(const char *path, unsigned int vertexStride, MappedMeshCache &cache)
+{
+	memset(&cache, 0, sizeof(cache));
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	void *view = NULL;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping != NULL)
+			view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (view == NULL) {
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	cache.File = file;
+	cache.FileMapping = mapping;
+	cache.Mapping = view;
+	cache.MappingSize = (size_t)size.QuadPart;
+#else
+	const int file = open(path, O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat info;
+	void *view = MAP_FAILED;
+	if (fstat(file, &info) == 0 && info.st_size > 0)
+		view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	if (view == MAP_FAILED) {
+		close(file);
+		return false;
+	}
+	// The whole file is read front to back during upload
+	madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+	cache.File = file;
+	cache.Mapping = view;
+	cache.MappingSize = (size_t)info.st_size;
+#endif
+
+	cache.Header = (const MeshCacheHeader*)cache.Mapping;
+	if (!validateMeshCache(cache, vertexStride)) {
+		unmapMeshCache(cache);
+		return false;
+	}
+
+	cache.Vertices = (const char*)cache.Mapping + cache.Header->VertexOffset;
+	cache.Indices = (const char*)cache.Mapping + cache.Header->IndexOffset;
+	return true;
+}
+
+void unmapMeshCache(MappedMeshCache &cache)
+{
+	if (cache.Mapping == NULL)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(cache.Mapping);
+	CloseHandle((HANDLE)cache.FileMapping);
+	CloseHandle((HANDLE)cache.File);
+#else
+	munmap(cache.Mapping, cache.MappingSize);
+	close(cache.File);
+#endif
+	memset(&cache, 0, sizeof(cache));
+}
+
+bool isMeshCacheStale(const char *sourcePath, const char *cachePath)
+{
+	struct stat source, cache;
+	if (stat(cachePath, &cache) != 0)
+		return true;
+	if (stat(sourcePath, &source) != 0)
+		return false;	// no source to rebuild from, the cache is all there is
+	return source.st_mtime > cache.st_mtime;
+}
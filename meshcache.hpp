@@ -0,0 +1,50 @@
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP
+
+#include <stddef.h>
+
+// Compiled mesh file : a small header followed by the interleaved vertex buffer and
+// the index buffer, both exactly as they are handed to glBufferData. Loading maps the
+// file and uploads straight from the mapped pages, nothing is parsed or copied.
+
+#define MESH_CACHE_MAGIC "RMSH"
+const unsigned int MeshCacheVersion = 1;
+
+struct MeshCacheHeader {
+	char Magic[4];
+	unsigned int Version;
+	unsigned int VertexStride;	// bytes per vertex
+	unsigned int VertexCount;
+	unsigned int IndexSize;		// bytes per index, 2 or 4
+	unsigned int IndexCount;
+	unsigned int VertexOffset;	// byte offsets from the start of the file
+	unsigned int IndexOffset;
+};
+
+struct MappedMeshCache {
+	const MeshCacheHeader *Header;
+	const void *Vertices;
+	const void *Indices;
+
+	void *Mapping;
+	size_t MappingSize;
+#ifdef _WIN32
+	void *File;
+	void *FileMapping;
+#else
+	int File;
+#endif
+};
+
+bool writeMeshCache(const char *path, const void *vertices, unsigned int vertexStride, unsigned int vertexCount,
+	const void *indices, unsigned int indexSize, unsigned int indexCount);
+
+// Maps the file read-only and validates its header against the expected vertex layout;
+// the index width is whatever the mesh was compiled with, see Header->IndexSize
+bool mapMeshCache(const char *path, unsigned int vertexStride, MappedMeshCache &cache);
+void unmapMeshCache(MappedMeshCache &cache);
+
+// True if the cache file is missing or older than its source
+bool isMeshCacheStale(const char *sourcePath, const char *cachePath);
+
+#endif
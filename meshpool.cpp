@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <GL/glew.h>
+
+#include "meshpool.hpp"
+
+void initMeshPool(MeshPool &pool, size_t vertexStride)
+{
+	pool.VertexArray = pool.VertexBuffer = pool.IndexBuffer = 0;
+	pool.InstanceBuffer = pool.CommandBuffer = 0;
+	pool.VertexStride = vertexStride;
+	pool.IndexType = GL_UNSIGNED_SHORT;
+	pool.Indirect = false;
+	pool.NumVertices = pool.NumIndices = 0;
+	pool.VertexCapacity = pool.IndexCapacity = 0;
+	pool.NumInstances = 0;
+	pool.Meshes.clear();
+	pool.Staging.Buffer = 0;
+}
+
+static void setInstanceAttributes(size_t baseInstance)
+{
+	const size_t base = sizeof(PoolInstance) * baseInstance;
+	// Matrix attributes take one location per column
+	for (int column = 0; column < 4; column++) {
+		glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(PoolInstance), (GLvoid*)(base + offsetof(PoolInstance, MVP) + sizeof(glm::vec4) * column));
+		glVertexAttribPointer(7 + column, 4, GL_FLOAT, GL_FALSE, sizeof(PoolInstance), (GLvoid*)(base + offsetof(PoolInstance, MV) + sizeof(glm::vec4) * column));
+	}
+	for (int column = 0; column < 3; column++)
+		glVertexAttribPointer(11 + column, 3, GL_FLOAT, GL_FALSE, sizeof(PoolInstance), (GLvoid*)(base + offsetof(PoolInstance, NormalMatrix) + sizeof(glm::vec3) * column));
+	glVertexAttribPointer(14, 4, GL_FLOAT, GL_FALSE, sizeof(PoolInstance), (GLvoid*)(base + offsetof(PoolInstance, Color)));
+	glVertexAttribPointer(15, 1, GL_FLOAT, GL_FALSE, sizeof(PoolInstance), (GLvoid*)(base + offsetof(PoolInstance, PickingColor)));
+}
+
+// Returns a buffer of at least needed bytes holding the first used bytes of buffer,
+// copied on the GPU; buffer itself when it is already big enough
+static GLuint growBuffer(GLuint buffer, size_t used, size_t &capacity, size_t needed)
+{
+	if (needed <= capacity)
+		return buffer;
+
+	size_t grown = capacity > 0 ? capacity : 64 * 1024;
+	while (grown < needed)
+		grown *= 2;
+
+	// The copy bindings leave the VAO's element buffer and GL_ARRAY_BUFFER alone
+	GLuint larger;
+	glGenBuffers(1, &larger);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, larger);
+	glBufferData(GL_COPY_WRITE_BUFFER, grown, NULL, GL_STATIC_DRAW);
+	if (used > 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &buffer);
+
+	capacity = grown;
+	return larger;
+}
+
+static void createMeshPoolObjects(MeshPool &pool)
+{
+	pool.Indirect = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+
+	glGenVertexArrays(1, &pool.VertexArray);
+	glBindVertexArray(pool.VertexArray);
+
+	// Instance attributes start out pointing at instance 0, the fallback path re-points them per draw
+	glGenBuffers(1, &pool.InstanceBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, pool.InstanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(PoolInstance), NULL, GL_STREAM_DRAW);
+	setInstanceAttributes(0);
+	for (int attribute = 3; attribute <= 15; attribute++) {
+		glVertexAttribDivisor(attribute, 1);
+		glEnableVertexAttribArray(attribute);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (pool.Indirect)
+		glGenBuffers(1, &pool.CommandBuffer);
+	glBindVertexArray(0);
+
+	createStagingRing(pool.Staging, MeshPoolStagingSize);
+}
+
+// Writes indices of either width into the staging memory at the pool's width, then into
+// the index buffer at offset bytes
+static void stageIndices(MeshPool &pool, const void *indices, GLenum indexType, unsigned int count, size_t offset)
+{
+	const size_t indexSize = pool.IndexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+	if (indexType == pool.IndexType) {
+		stageUpload(pool.Staging, indices, indexSize * count, pool.IndexBuffer, offset);
+		return;
+	}
+
+	for (unsigned int done = 0; done < count; ) {
+		size_t bytes;
+		unsigned char *staging = mapStaging(pool.Staging, indexSize * (count - done), bytes);
+		const unsigned int chunk = (unsigned int)(bytes / indexSize);
+		if (pool.IndexType == GL_UNSIGNED_SHORT) {
+			const GLuint *wide = (const GLuint*)indices + done;
+			for (unsigned int i = 0; i < chunk; i++)
+				((GLushort*)staging)[i] = (GLushort)wide[i];
+		}
+		else {
+			const GLushort *narrow = (const GLushort*)indices + done;
+			for (unsigned int i = 0; i < chunk; i++)
+				((GLuint*)staging)[i] = narrow[i];
+		}
+		copyStaging(pool.Staging, indexSize * chunk, pool.IndexBuffer, offset + indexSize * done);
+		done += chunk;
+	}
+}
+
+// A mesh too large for 16-bit indices widens the whole pool once : the uploaded indices
+// are read back and staged again into a new 32-bit index buffer
+static void widenPoolIndices(MeshPool &pool)
+{
+	std::vector<GLushort> uploaded(pool.NumIndices);
+	if (!uploaded.empty()) {
+		glBindBuffer(GL_COPY_READ_BUFFER, pool.IndexBuffer);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(GLushort) * uploaded.size(), &uploaded[0]);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+
+	pool.IndexType = GL_UNSIGNED_INT;
+	pool.IndexCapacity = 0;
+	pool.IndexBuffer = growBuffer(pool.IndexBuffer, 0, pool.IndexCapacity, sizeof(GLuint) * uploaded.size());
+	if (!uploaded.empty())
+		stageIndices(pool, &uploaded[0], GL_UNSIGNED_SHORT, (unsigned int)uploaded.size(), 0);
+}
+
+int addPoolMesh(MeshPool &pool, const void *vertices, unsigned int vertexCount, const void *indices, GLenum indexType, unsigned int indexCount)
+{
+	if (pool.VertexArray == 0)
+		createMeshPoolObjects(pool);
+	if (pool.IndexType == GL_UNSIGNED_SHORT && vertexCount > 65536)
+		widenPoolIndices(pool);
+
+	PoolMesh mesh;
+	mesh.BaseVertex = GLint(pool.NumVertices);
+	mesh.FirstIndex = pool.NumIndices;
+	mesh.IndexCount = indexCount;
+	mesh.VertexCount = vertexCount;
+
+	// Appended behind what is already on the GPU
+	const size_t vertexUsed = pool.VertexStride * pool.NumVertices;
+	const size_t vertexBytes = pool.VertexStride * vertexCount;
+	pool.VertexBuffer = growBuffer(pool.VertexBuffer, vertexUsed, pool.VertexCapacity, vertexUsed + vertexBytes);
+	stageUpload(pool.Staging, vertices, vertexBytes, pool.VertexBuffer, vertexUsed);
+
+	const size_t indexSize = pool.IndexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+	const size_t indexUsed = indexSize * pool.NumIndices;
+	pool.IndexBuffer = growBuffer(pool.IndexBuffer, indexUsed, pool.IndexCapacity, indexUsed + indexSize * indexCount);
+	stageIndices(pool, indices, indexType, indexCount, indexUsed);
+
+	pool.NumVertices += vertexCount;
+	pool.NumIndices += indexCount;
+
+	pool.Meshes.push_back(mesh);
+	return int(pool.Meshes.size()) - 1;
+}
+
+void uploadMeshPool(MeshPool &pool)
+{
+	if (pool.VertexArray == 0)
+		createMeshPoolObjects(pool);
+
+	// The staging ring only waits for these copies if it wraps around before they are done
+	fenceStaging(pool.Staging);
+
+	// Growing replaced the buffers, the element binding is VAO state
+	glBindVertexArray(pool.VertexArray);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.IndexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, pool.VertexBuffer);
+}
+
+void destroyMeshPool(MeshPool &pool)
+{
+	glDeleteBuffers(1, &pool.VertexBuffer);
+	glDeleteBuffers(1, &pool.IndexBuffer);
+	glDeleteBuffers(1, &pool.InstanceBuffer);
+	glDeleteBuffers(1, &pool.CommandBuffer);
+	glDeleteVertexArrays(1, &pool.VertexArray);
+	destroyStagingRing(pool.Staging);
+	pool.VertexArray = pool.VertexBuffer = pool.IndexBuffer = 0;
+	pool.InstanceBuffer = pool.CommandBuffer = 0;
+	pool.VertexCapacity = pool.IndexCapacity = 0;
+}
+
+void printMeshPool(const MeshPool &pool)
+{
+	const size_t indexSize = pool.IndexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+	printf("Mesh pool : %u meshes, %.1f KB vertices, %.1f KB %d-bit indices (%.1f KB allocated), %s submission\n",
+		(unsigned int)pool.Meshes.size(), pool.VertexStride * pool.NumVertices / 1024.0,
+		indexSize * pool.NumIndices / 1024.0, int(8 * indexSize),
+		(pool.VertexCapacity + pool.IndexCapacity) / 1024.0, pool.Indirect ? "multi-draw indirect" : "base-vertex loop");
+	printf("Mesh staging : %.1f KB through a %.0f KB %s ring, %u waits\n", pool.Staging.BytesStaged / 1024.0,
+		pool.Staging.Capacity / 1024.0, pool.Staging.Persistent ? "persistently mapped" : "orphaned", pool.Staging.Waits);
+}
+
+void uploadPoolInstances(MeshPool &pool, const PoolInstance *instances, int count)
+{
+	const GLsizeiptr size = sizeof(PoolInstance) * count;
+	glBindBuffer(GL_ARRAY_BUFFER, pool.InstanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, instances);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	pool.NumInstances = count;
+}
+
+DrawElementsIndirectCommand poolCommand(const MeshPool &pool, int mesh, int instanceCount, int baseInstance)
+{
+	DrawElementsIndirectCommand command;
+	command.Count = pool.Meshes[mesh].IndexCount;
+	command.InstanceCount = instanceCount;
+	command.FirstIndex = pool.Meshes[mesh].FirstIndex;
+	command.BaseVertex = pool.Meshes[mesh].BaseVertex;
+	command.BaseInstance = baseInstance;
+	return command;
+}
+
+// Mesh whose indices hold firstIndex : meshes are appended, so they are in FirstIndex order
+static const PoolMesh *poolMeshAt(const MeshPool &pool, GLuint firstIndex)
+{
+	int low = 0, high = (int)pool.Meshes.size();
+	while (low < high) {
+		const int middle = (low + high) / 2;
+		if (pool.Meshes[middle].FirstIndex <= firstIndex)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low > 0 ? &pool.Meshes[low - 1] : NULL;
+}
+
+void drawMeshPool(MeshPool &pool, const DrawElementsIndirectCommand *commands, int count, DrawValidator &validator, const char *name)
+{
+	// Nothing loaded yet
+	if (count == 0)
+		return;
+
+	glBindVertexArray(pool.VertexArray);
+
+	const size_t indexSize = pool.IndexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+	for (int i = 0; i < count; i++) {
+		recordDrawElements(validator, name, GL_TRIANGLES, commands[i].Count, pool.IndexType, indexSize * commands[i].FirstIndex, commands[i].InstanceCount);
+		if (validator.Validate) {
+			// The buffers have room to grow, the meshes in them end at NumIndices and NumVertices
+			checkDrawRange(validator, name, "pool indices", commands[i].FirstIndex, commands[i].Count, pool.NumIndices);
+			// Indices are relative to their mesh : the draw reads its whole vertex range from BaseVertex on
+			const PoolMesh *mesh = poolMeshAt(pool, commands[i].FirstIndex);
+			if (mesh) {
+				checkDrawRange(validator, name, "mesh indices", commands[i].FirstIndex - mesh->FirstIndex, commands[i].Count, mesh->IndexCount);
+				checkDrawRange(validator, name, "mesh vertices", commands[i].BaseVertex, mesh->VertexCount, pool.NumVertices);
+			}
+			checkDrawRange(validator, name, "instances", commands[i].BaseInstance, commands[i].InstanceCount, pool.NumInstances);
+		}
+	}
+
+	if (pool.Indirect) {
+		validator.Frame.Submissions++;
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, pool.CommandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * count, commands, GL_STREAM_DRAW);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, pool.IndexType, 0, count, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	else {
+		// No base instance before GL 4.2 : the instance attributes are re-pointed instead
+		validator.Frame.Submissions += count;
+		glBindBuffer(GL_ARRAY_BUFFER, pool.InstanceBuffer);
+		for (int i = 0; i < count; i++) {
+			setInstanceAttributes(commands[i].BaseInstance);
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, commands[i].Count, pool.IndexType,
+				(GLvoid*)(indexSize * commands[i].FirstIndex), commands[i].InstanceCount, commands[i].BaseVertex);
+		}
+		setInstanceAttributes(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	glBindVertexArray(0);
+}
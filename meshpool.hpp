@@ -0,0 +1,100 @@
+#ifndef MESHPOOL_HPP
+#define MESHPOOL_HPP
+
+#include <stddef.h>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "drawstats.hpp"
+#include "stagingring.hpp"
+
+// Every mesh suballocated from one vertex buffer and one index buffer behind a single VAO.
+// Indices stay relative to their own mesh and are offset by BaseVertex at draw time, so
+// 16-bit indices are kept as long as each mesh on its own fits them. A frame is one
+// command per mesh, submitted with a single glMultiDrawElementsIndirect when the driver
+// has GL 4.3 (or ARB_multi_draw_indirect + ARB_base_instance), otherwise as a loop of
+// glDrawElementsInstancedBaseVertex with no VAO or buffer binds in between.
+//
+// Meshes are written through a staging ring straight into the GPU buffers as they are added,
+// without a CPU copy in the pool; the buffers grow by copying on the GPU, so parts can
+// stream in while drawing.
+//
+// Per-draw state comes from one shared instance buffer : command n draws InstanceCount
+// instances starting at BaseInstance, so the model matrices, material colors and
+// picking IDs of the whole frame are uploaded once.
+
+struct PoolMesh {
+	GLint BaseVertex;
+	GLuint FirstIndex;
+	GLuint IndexCount;
+	GLuint VertexCount;
+};
+
+// Instance attributes : 3-6 MVP, 7-10 MV, 11-13 normal matrix, 14 material color, 15 picking color
+struct PoolInstance {
+	glm::mat4 MVP;
+	glm::mat4 MV;
+	glm::mat3 NormalMatrix;
+	glm::vec4 Color;
+	float PickingColor;
+};
+
+// GL_DRAW_INDIRECT_BUFFER layout
+struct DrawElementsIndirectCommand {
+	GLuint Count;
+	GLuint InstanceCount;
+	GLuint FirstIndex;
+	GLint BaseVertex;
+	GLuint BaseInstance;
+};
+
+struct MeshPool {
+	GLuint VertexArray;
+	GLuint VertexBuffer;
+	GLuint IndexBuffer;
+	GLuint InstanceBuffer;
+	GLuint CommandBuffer;
+
+	size_t VertexStride;
+	GLenum IndexType;			// GL_UNSIGNED_SHORT until a mesh needs more, then widened once
+	bool Indirect;				// multi-draw indirect available
+	GLuint NumVertices;			// including meshes not uploaded yet
+	GLuint NumIndices;
+	size_t VertexCapacity;		// bytes of GPU storage
+	size_t IndexCapacity;
+	int NumInstances;			// instances in the last upload
+
+	std::vector<PoolMesh> Meshes;
+	StagingRing Staging;
+};
+
+const size_t MeshPoolStagingSize = 1024 * 1024;
+
+void initMeshPool(MeshPool &pool, size_t vertexStride);
+
+// Stages a mesh (indices of either width) into the pool's buffers and returns its slot in
+// Meshes; the caller's copy can be freed straight away. Needs a current GL context, and
+// the mesh can be drawn after the next uploadMeshPool().
+int addPoolMesh(MeshPool &pool, const void *vertices, unsigned int vertexCount, const void *indices, GLenum indexType, unsigned int indexCount);
+
+// Creates the buffers and the VAO with the instance attributes on the first call, and
+// fences the copies of the meshes added since.
+// Returns with the pool's VAO and vertex buffer bound so the caller can describe its vertex
+// layout (attributes 0-2) before unbinding; a grown vertex buffer is a new buffer object.
+void uploadMeshPool(MeshPool &pool);
+void destroyMeshPool(MeshPool &pool);
+
+void printMeshPool(const MeshPool &pool);
+
+// Replaces the instance data of the frame (orphaning the previous storage)
+void uploadPoolInstances(MeshPool &pool, const PoolInstance *instances, int count);
+
+// Command of mesh drawing instanceCount instances from baseInstance on
+DrawElementsIndirectCommand poolCommand(const MeshPool &pool, int mesh, int instanceCount, int baseInstance);
+
+// Submits every command; binds the pool's VAO and leaves it unbound again.
+// Each command is counted (and validated) as one draw of name.
+void drawMeshPool(MeshPool &pool, const DrawElementsIndirectCommand *commands, int count, DrawValidator &validator, const char *name);
+
+#endif
@@ -1,10 +1,14 @@
 // Include standard headers
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <float.h>
 #include <vector>
 #include <array>
 #include <stack>   
 #include <sstream>
+#include <chrono>
 // Include GLEW
 #include <GL/glew.h>
 // Include GLFW
@@ -14,6 +18,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
 using namespace glm;
 
 // Include AntTweakBar
@@ -23,6 +28,26 @@ using namespace glm;
 #include <common/controls.hpp>
 #include <common/objloader.hpp>
 #include <common/vboindexer.hpp>
+
+#include "scenegraph.hpp"
+#include "rigbatch.hpp"
+#include "rigworld.hpp"
+#include "asyncpicker.hpp"
+#include "bvh.hpp"
+#include "meshcache.hpp"
+#include "hashindexer.hpp"
+#include "frameprofiler.hpp"
+#include "headless.hpp"
+#include "meshpool.hpp"
+#include "drawstats.hpp"
+#include "uniformring.hpp"
+#include "framescheduler.hpp"
+#include "assetloader.hpp"
+#include "objparser.hpp"
+#include "alloccounter.hpp"
+#include "inputqueue.hpp"
+#include "jobsystem.hpp"
+#include "rigik.hpp"
 #define PI 3.1415926535897
 
 const int window_width = 1024, window_height = 768;
@@ -50,25 +75,104 @@ typedef struct Vertex {
 	}
 };
 
+// std140 mirrors of the shaders' FrameBlock and ObjectBlock
+struct FrameUniforms {
+	glm::mat4 V;
+	glm::mat4 P;
+	glm::vec4 LightPosition;		// camera space
+	glm::vec4 LightPosition2;
+};
+
+struct ObjectUniforms {
+	glm::mat4 MVP;
+	glm::mat4 MV;
+	glm::vec4 NormalMatrix[3];		// std140 mat3 : one vec4 per column
+	glm::vec4 MaterialColor;
+	float PickingColor;
+	GLint UseInstanceMatrix;
+	float Pad[2];
+};
+
+// Compact layout for loaded meshes : float3 position (w is filled in as 1 by the
+// attribute fetch) and a signed 10:10:10:2 normal, no color. 16 bytes against 44.
+typedef struct CompactVertex {
+	float Position[3];
+	GLuint Normal;		// GL_INT_2_10_10_10_REV, x in the low bits, w unused
+	void SetPosition(float *coords) {
+		Position[0] = coords[0];
+		Position[1] = coords[1];
+		Position[2] = coords[2];
+	}
+	void SetNormal(float *coords) {
+		Normal = 0;
+		for (int i = 0; i < 3; i++) {
+			const int c = int(glm::floor(glm::clamp(coords[i], -1.0f, 1.0f) * 511.0f + 0.5f));
+			Normal |= (GLuint(c) & 0x3FF) << (10 * i);
+		}
+	}
+};
+
+enum VertexLayout {
+	LegacyLayout,	// Vertex
+	CompactLayout	// CompactVertex
+};
+
 // function prototypes
 int initWindow(void);
 void initOpenGL(void);
-void loadObject(char*, glm::vec4, Vertex * &, GLushort* &, int);
-void createVAOs(Vertex[], GLushort[], int);
+void loadObject(char*, VertexLayout, LoadedMesh &, ScratchArena &);
+void loadMeshFile(LoadedMesh &, ScratchArena &);
+void addLoadedMesh(LoadedMesh *);
+void pollAssetLoads(bool);
+std::string meshCachePath(const char*, VertexLayout);
+bool benchmarkMeshCache(int, char*[]);
+bool benchmarkLoadAllocations(int, char*[]);
+void createVAOs(const GLvoid*, const GLvoid*, int);
+void setVertexAttributes(VertexLayout);
 void createObjects(void);
-void pickObject(void);
+void drawPickingPass(void);
+void pickObject(double, double);
+int pickObjectAt(double, double);
+void pickObjectAsync(double, double);
+void selectPickedObject(int);
+int pickObjectRay(double, double, RayHit &);
 void renderScene(void);
+void drawScene(void);
+void updateJoints(void);
+JointState captureJoints(void);
+void applyJoints(const JointState &);
+JointState interpolateJoints(const JointState &, const JointState &, float);
+bool needsRedraw(void);
+static void refreshCallback(GLFWwindow*);
+void updatePoolInstances(void);
+void resizeStressRigs(int);
+void updateRigChunk(RigWorld &, int, int, void *);
+void writeRigInstances(int, int, const glm::mat4 &);
+void moveJoint(RigJoint, float);
+glm::vec3 traceTarget(int, float);
+void traceCircle(void);
+void traceRigChunk(RigWorld &, int, int, void *);
+void traceStressRigs(void);
+void initProfiler(void);
+void endFrameStats(void);
+void updateFrameUniforms(void);
+void computeObjectConstants(const glm::mat4 &, const glm::mat4 &, const glm::mat4 &, glm::mat4 &, glm::mat4 &, glm::mat3 &);
+int runHeadlessBenchmark(int, const char*, const char*);
 void cleanup(void);
 static void keyCallback(GLFWwindow*, int, int, int, int);
 static void mouseCallback(GLFWwindow*, int, int, int);
+static void cursorCallback(GLFWwindow*, double, double);
+void applyInputCommand(const InputCommand &);
+void applyKeyCommand(int, bool);
+void applyPickCommand(double, double);
+void applyHoverCommand(double, double);
 glm::vec3 setLookat(void);
 void rotateCamera(void);
 void deselectObjectIndicies(void);
 
-// SRT Functions
-void translateObjectMatrix(glm::mat4x4*, glm::mat4x4, glm::vec3);
-void rotateObjectMatrix(glm::mat4x4*, glm::mat4x4, float, glm::vec3);
-void scaleObjectMatrix(glm::mat4x4*, glm::mat4x4, glm::vec3);
+// Scene Graph Functions
+void createRigNodes(void);
+void updateRigNodes(void);
 
 // Object Setup
 void translateBasePosition(void);
@@ -87,29 +191,85 @@ glm::mat4 gViewMatrix;
 GLuint gPickedIndex = -1;
 std::string gMessage;
 
+// Picking without the glFinish/glReadPixels stall, results land a frame or two later
+AsyncPicker gAsyncPicker;
+bool gAsyncPicking = true;
+
+// CPU picking : rays against per-mesh BVHs, no GPU work, cheap enough to run on every mouse move
+bool gRayPicking = false;
+std::string gHoverMessage;
+
+// Frame instrumentation, shown in the "Performance" bar
+FrameProfiler gProfiler;
+int FrameTimer, UpdateTimer, RenderTimer, PickTimer, PresentTimer;	// CPU
+int ScenePassTimer, PickPassTimer, GuiPassTimer;					// GPU
+int DrawCallCounter, MeshDrawCounter, TriangleCounter, VertexCounter;
+int IkIterationCounter, IkTimeCounter, IkMissedCounter;
+
+// Geometry submitted per frame, --validate-draws also checks every draw against its buffers
+DrawValidator gDrawStats;
+
 GLuint programID;
 GLuint pickingProgramID;
 
-const GLuint NumObjects = 16;
-GLuint VertexArrayId[NumObjects] = { 0, 
-									 1, 2, 3, 4, 5, 6, 7, 8, // Base Objects 
-									 9, 10, 11, 12, 13, 14, 15 // Selected Objects
-								   };
-GLuint VertexBufferId[NumObjects] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
-GLuint IndexBufferId[NumObjects] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
-
-size_t NumIndices[NumObjects] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
-size_t VertexBufferSize[NumObjects] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
-size_t IndexBufferSize[NumObjects] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
-
-GLuint MatrixID;
-GLuint ModelMatrixID;
-GLuint ViewMatrixID;
-GLuint ProjMatrixID;
-GLuint PickingMatrixID;
-GLuint pickingColorID;
-GLuint LightID;
-GLuint LightID2;
+// Every mesh is uploaded once, selection only changes the material color it is drawn with
+const GLuint NumObjects = 9;
+// Own buffers of the hand-made axes and grid, loaded meshes live in gMeshPool and keep 0 here
+GLuint VertexArrayId[NumObjects] = { 0 };
+GLuint VertexBufferId[NumObjects] = { 0 };
+GLuint IndexBufferId[NumObjects] = { 0 };
+
+size_t NumIndices[NumObjects] = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+size_t VertexBufferSize[NumObjects] = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+size_t IndexBufferSize[NumObjects] = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+// GL_UNSIGNED_SHORT when every index fits in 16 bits, GL_UNSIGNED_INT otherwise
+GLenum IndexType[NumObjects] = { 0 };
+// Hand-made objects keep the legacy layout for their per-vertex colors
+VertexLayout ObjectLayout[NumObjects] = { LegacyLayout };
+// Layout loaded meshes are built with, --legacy-vertices switches back to Vertex
+VertexLayout gMeshLayout = CompactLayout;
+
+// Loaded meshes share one vertex and index buffer, PoolMeshIndex maps an object to its slot
+MeshPool gMeshPool;
+int PoolMeshIndex[NumObjects] = { -1, -1 };
+
+// Model space BVH of every loaded mesh, empty for the hand-made axes and grid
+MeshBVH ObjectBVH[NumObjects];
+
+// Parts are parsed on worker threads and added to the pool between frames as they finish
+AssetLoader gAssetLoader;
+int gLoaderThreads = 0;			// 0 : one per hardware thread
+double gLoadStart;
+
+const char* ObjectNames[NumObjects] = { "Axes", "Grid",
+										"Base", "Arm1", "Arm2", "Button", "Joint", "Pen", "Top"
+									  };
+
+// Per-object material, multiplied with the vertex color (white for every loaded mesh)
+const glm::vec4 White = glm::vec4(1.0, 1.0, 1.0, 1.0);
+const glm::vec4 ObjectColor[NumObjects] = { White, White,
+											glm::vec4(1.0, 0.0, 0.0, 1.0), // Base
+											glm::vec4(0.0, 0.0, 1.0, 1.0), // Arm1
+											glm::vec4(0.0, 1.0, 1.0, 1.0), // Arm2
+											glm::vec4(1.0, 0.0, 0.0, 1.0), // Button
+											glm::vec4(1.0, 0.0, 1.0, 1.0), // Joint
+											glm::vec4(1.0, 1.0, 0.0, 1.0), // Pen
+											glm::vec4(0.0, 1.0, 0.0, 1.0)  // Top
+										  };
+const glm::vec4 SelectedColor[NumObjects] = { White, White,
+											  White, White, White,
+											  glm::vec4(1.0, 1.0, 0.0, 1.0), // Button
+											  White, White, White
+											};
+bool ObjectSelected[NumObjects] = { false };
+
+// Uniform block bindings shared by both programs, the blocks of a frame are uploaded together
+const GLuint FrameBlockBinding = 0;
+const GLuint ObjectBlockBinding = 1;
+UniformRing gUniforms;
+size_t FrameBlockOffset;
+size_t StaticObjectOffset;		// axes and grid : identity M, white
+size_t InstancedObjectOffset;	// pooled rig parts : everything from the instance attributes
 
 GLint gX = 0.0;
 GLint gZ = 0.0;
@@ -126,99 +286,546 @@ int shiftPressed = 0;
 int rotationDirection; // Direction of rotation (L/R, U/D)
 float thetaX, thetaY = 1.0; // Rotation positions for left/right & up/down movement of camera
 
-// Object Variables
-float BaseXPosition = 0.0;
-float BaseZPosition = 0.0;
-float TopYRotation = 0.0;
-float Arm1ZRotation = 0.0;
-float Arm2ZRotation = 0.0;
-float PenXRotation = 0.0;
-float PenZRotation = 0.0;
-float PenYRotation = 0.0;
-								 
-// Object Matricies
-glm::mat4x4 BaseModelMatrix = glm::mat4(1.0);
-glm::mat4x4 Arm1ModelMatrix = glm::mat4(1.0);
-glm::mat4x4 Arm2ModelMatrix = glm::mat4(1.0);
-glm::mat4x4 TopModelMatrix = glm::mat4(1.0);
-glm::mat4x4 ButtonModelMatrix = glm::mat4(1.0);
-glm::mat4x4 JointModelMatrix = glm::mat4(1.0);
-glm::mat4x4 PenModelMatrix = glm::mat4(1.0);
+// Everything a fixed update moves, rendering draws between the last two of these.
+// The joints of the driven rig come first, in RigJoint order
+struct JointState {
+	float BaseXPosition, BaseZPosition;
+	float TopYRotation, Arm1ZRotation, Arm2ZRotation;
+	float PenXRotation, PenZRotation, PenYRotation;
+	float ThetaX, ThetaY;
+};
+
+// Joints and camera advance at UpdateRate whatever the frame rate
+FrameScheduler gScheduler;
+JointState gPreviousJoints;
+double gUpdateRate = 60.0;
+double gMaxFps = 0.0;			// 0 : no cap beyond the swap
+bool gVSync = true;
+
+// On demand : the loop sleeps in glfwWaitEvents until input, a pick or moving joints need a new frame
+bool gRenderOnDemand = false;
+bool gRedraw = true;				// set by every input callback and selection change
+JointState gDrawnJoints;			// pose of the last frame drawn
+
+// Callbacks only queue input, the main loop applies it between frames; --record and --replay log it
+InputQueue gInput;
+const char* gRecordPath = NULL;
+const char* gReplayPath = NULL;
 
 // Object Indicies
-unsigned int BaseIndex = 2;
-unsigned int Arm1Index = 3;
-unsigned int Arm2Index = 4;
-unsigned int ButtonIndex = 5;
-unsigned int JointIndex = 6;
-unsigned int PenIndex = 7;
-unsigned int TopIndex = 8;
-
-
-void translateObjectMatrix(glm::mat4x4 *ModelMatrixToSet, glm::mat4x4 ModelMatrixToTranslateOff, glm::vec3 TranslationDirection) {
-
-	// Translate ModelMatrixToSet  by TranslationDirection from Basis ModelMatrixToTranslateOff
-	*ModelMatrixToSet = glm::translate(
-		ModelMatrixToTranslateOff,
-		TranslationDirection
-		);
-}
+const unsigned int BaseIndex = 2;
+const unsigned int Arm1Index = 3;
+const unsigned int Arm2Index = 4;
+const unsigned int ButtonIndex = 5;
+const unsigned int JointIndex = 6;
+const unsigned int PenIndex = 7;
+const unsigned int TopIndex = 8;
+
+// Scene Graph
+// World matrices are cached here and shared by the render and picking passes
+SceneGraph gScene;
+
+// Rig nodes, in the order createRigNodes() adds them (parents first)
+enum RigNode {
+	BaseNode,
+	TopNode,
+	Arm1Node,
+	JointNode,
+	Arm2Node,
+	PenMountNode,	// Pen tilt (X/Z), carries no geometry
+	PenNode,		// Pen spin (Y)
+	ButtonNode,
+	NumRigNodes
+};
 
-void rotateObjectMatrix(glm::mat4x4 *ModelMatrixToSet, glm::mat4x4 ModelMatrixToRotateOff, float rotation, glm::vec3 RotationDirection) {
+// Drawable rig parts : scene node + object drawn for it
+struct RigPart {
+	int Node;
+	unsigned int ObjectIndex;
+};
 
-	// Rotate Object Model Matrix by rotation in RotationDirection from Basis ModelMatrixToRotateOff
-	*ModelMatrixToSet = glm::rotate(
-		ModelMatrixToRotateOff,
-		rotation,
-		RotationDirection
-		);
-	
+// Same order as RigBatchPart, so RigParts[i] is drawn from gRigs.World[i]
+const int NumRigParts = 7;
+RigPart RigParts[NumRigParts] = {
+	{ BaseNode, BaseIndex },
+	{ TopNode, TopIndex },
+	{ Arm1Node, Arm1Index },
+	{ JointNode, JointIndex },
+	{ Arm2Node, Arm2Index },
+	{ PenNode, PenIndex },
+	{ ButtonNode, ButtonIndex }
+};
+
+// Joints, limits and world matrices of every rig; the keys drive gRig
+RigWorld gWorld;
+RigHandle gRig = NullRig;
+
+// Joint limits of the interactive arm in RigJoint order, every rig is added with its own copy
+const RigLimits ArmLimits = {
+	{ -5.0f, -5.0f, -FLT_MAX, float((-1) * PI / 4), float((-1) * PI / 3), float((-1) * PI / 3), float((-1) * PI / 4), float((-1) * PI / 2) },
+	{ 5.0f, 5.0f, FLT_MAX, float(2 * PI / 3), float(PI), float(PI / 3), float(PI / 4), float(PI / 2) }
+};
+
+// Stress scene : with more than one rig every part is drawn once, instanced over all rigs.
+// gRig stands at the origin, the others follow its joints from their own spot of a square
+// grid, offset a little so the floor doesn't move in lockstep.
+int gRigCount = 1;
+const float RigSpacing = 3.0f;
+std::vector<RigHandle> gStressRigs;
+
+// Rig updates and their instance constants run as chunk jobs on every core, --threads limits them
+JobSystem gJobs;
+int gJobThreads = 0;			// 0 : one per hardware thread
+
+// Trace mode (key I) : pen tips follow circles on the floor through the IK solver, the driven
+// rig's on every update, the others' every frame around their own spot of the grid
+const float TraceDistance = 2.2f;		// circle centre, along X from the base
+const float TraceRadius = 0.75f;
+const float TraceHeight = 0.0f;			// on the floor
+const float TraceSpeed = 0.05f;			// radians per update
+float gTraceAngle = 0.0f;
+RigTargets gTargets;
+
+// IK solves since the last frame's stats. Seconds add up each solve's own time whatever thread
+// ran it, so the time per target does not depend on the thread count
+int gIkTargets = 0;
+int gIkMissed = 0;						// targets out of reach
+double gIkIterations = 0.0;
+double gIkSeconds = 0.0;
+std::vector<double> gTraceChunkSeconds;	// follower solve time, one slot per RigWorldChunk
+
+// This frame's rig draws : part i covers instances [i * gRigCount, (i + 1) * gRigCount)
+std::vector<PoolInstance> gPoolInstances;
+DrawElementsIndirectCommand gPoolCommands[NumRigParts];
+int gPoolCommandCount = 0;		// parts loaded so far
+
+
+void createRigNodes(void)
+{
+	const glm::vec3 ZAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+	const glm::quat NoRotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+
+	// Each joint rotates about its pivot, Offset carries the geometry out to the next pivot
+	gScene.addNode(-1);
+	gScene.addNode(BaseNode, glm::vec3(0.0f), NoRotation, glm::vec3(1.0f), glm::vec3(0.0f, 0.75f, 0.0f));
+	gScene.addNode(TopNode, glm::vec3(0.0f), NoRotation, glm::vec3(1.0f), glm::vec3(0.0f, 0.75f, 0.0f));
+	gScene.addNode(Arm1Node, glm::vec3(0.0f), NoRotation, glm::vec3(0.65f), glm::vec3(0.0f, 2.05f, 0.0f));
+	gScene.addNode(JointNode, glm::vec3(0.0f), NoRotation, glm::vec3(2.0f), glm::vec3(0.0f, 0.5f, 0.0f));
+	// Pen sits 0.6 out along the Arm2 tip, turned a quarter around Z
+	gScene.addNode(Arm2Node, axisRotation(float(2 * PI / 4), ZAxis) * glm::vec3(0.6f, 0.0f, 0.0f), NoRotation, glm::vec3(1.0f), glm::vec3(0.0f, 0.2f, 0.0f));
+	gScene.addNode(PenMountNode);
+	gScene.addNode(PenNode, glm::vec3(0.0f), NoRotation, glm::vec3(1.0f), glm::vec3(0.05f, 0.0f, 0.0f));
+
+	gRig = addRig(gWorld, ArmLimits, 0.0f, 0.0f);
+	updateRigNodes();
+}
+
+void updateRigNodes(void)
+{
+	const glm::vec3 XAxis = glm::vec3(1.0f, 0.0f, 0.0f);
+	const glm::vec3 YAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+	const glm::vec3 ZAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+
+	// Push joint values into the graph, only joints that moved get dirtied
+	const JointState joints = captureJoints();
+	gScene.setTranslation(BaseNode, glm::vec3(0.0f + joints.BaseXPosition, 0.5f, 0.0f + joints.BaseZPosition));
+	gScene.setRotation(TopNode, axisRotation(joints.TopYRotation, YAxis));
+	gScene.setRotation(Arm1Node, axisRotation(float((-1) * PI / 4) + joints.Arm1ZRotation, ZAxis));
+	gScene.setRotation(Arm2Node, axisRotation(float((-1) * PI / 2.5) + joints.Arm2ZRotation, ZAxis));
+	gScene.setRotation(PenMountNode, axisRotation(float(2 * PI / 4), ZAxis) * axisRotation(joints.PenXRotation, XAxis) * axisRotation(joints.PenZRotation, ZAxis));
+	gScene.setRotation(PenNode, axisRotation(joints.PenYRotation, YAxis));
+
+	gScene.updateWorldMatrices();
 }
 
-void scaleObjectMatrix(glm::mat4x4 *ModelMatrixToSet, glm::mat4x4 ModelMatrixToScaleOff, glm::vec3 ScaleAmount) {
-		
-	// Scale Object Model Matrix by ScaleAmount from Basis ModelMatrixToScaleOff
-	*ModelMatrixToSet = glm::scale(
-		ModelMatrixToScaleOff,
-		ScaleAmount
-		);
 
+size_t indexSize(GLenum type)
+{
+	return type == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
 }
 
+size_t vertexStride(VertexLayout layout)
+{
+	return layout == CompactLayout ? sizeof(CompactVertex) : sizeof(Vertex);
+}
 
-void loadObject(char* file, glm::vec4 color, Vertex * &out_Vertices, GLushort* &out_Indices, int ObjectId)
+// Parses and indexes an .obj into mesh; runs on a loader thread, so it leaves GL and the scene alone.
+// Every temporary lives in scratch, only the final vertex and index arrays and the BVH are kept.
+void loadObject(char* file, VertexLayout layout, LoadedMesh &mesh, ScratchArena &scratch)
 {
 	// Read our .obj file
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec2> uvs;
-	std::vector<glm::vec3> normals;
-	bool res = loadOBJ(file, vertices, normals);
-
-	std::vector<GLushort> indices;
-	std::vector<glm::vec3> indexed_vertices;
-	std::vector<glm::vec2> indexed_uvs;
-	std::vector<glm::vec3> indexed_normals;
-	indexVBO(vertices, normals, indices, indexed_vertices, indexed_normals);
-
-	const size_t vertCount = indexed_vertices.size();
-	const size_t idxCount = indices.size();
-
-	// populate output arrays
-	out_Vertices = new Vertex[vertCount];
-	for (int i = 0; i < vertCount; i++) {
-		out_Vertices[i].SetPosition(&indexed_vertices[i].x);
-		out_Vertices[i].SetNormal(&indexed_normals[i].x);
-		out_Vertices[i].SetColor(&color[0]);
+	ObjSoup soup;
+	mesh.Ok = parseOBJ(file, scratch, soup) && soup.Count > 0;
+	if (!mesh.Ok)
+		return;
+
+	unsigned int* indices = scratchArray<unsigned int>(scratch, soup.Count);
+	glm::vec3* indexed_vertices = scratchArray<glm::vec3>(scratch, soup.Count);
+	glm::vec3* indexed_normals = scratchArray<glm::vec3>(scratch, soup.Count);
+	const size_t vertCount = indexVerticesHashed(soup.Positions, soup.Normals, soup.Count, indices, indexed_vertices, indexed_normals, scratch);
+	const size_t idxCount = soup.Count;
+
+	// populate output arrays in their final layout, the color comes from the object's material at draw time
+	mesh.VertexStorage.resize(vertexStride(layout) * vertCount);
+	if (layout == CompactLayout) {
+		CompactVertex* compactVertices = (CompactVertex*)&mesh.VertexStorage[0];
+		for (int i = 0; i < vertCount; i++) {
+			compactVertices[i].SetPosition(&indexed_vertices[i].x);
+			compactVertices[i].SetNormal(&indexed_normals[i].x);
+		}
+	}
+	else {
+		glm::vec4 color = White;
+		Vertex* legacyVertices = (Vertex*)&mesh.VertexStorage[0];
+		for (int i = 0; i < vertCount; i++) {
+			legacyVertices[i].SetPosition(&indexed_vertices[i].x);
+			legacyVertices[i].SetNormal(&indexed_normals[i].x);
+			legacyVertices[i].SetColor(&color[0]);
+		}
+	}
+
+	// 16-bit indices whenever they can address every vertex, half the index bandwidth
+	const GLenum indexType = vertCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	mesh.IndexStorage.resize(indexSize(indexType) * idxCount);
+	if (indexType == GL_UNSIGNED_SHORT) {
+		GLushort* shortIndices = (GLushort*)&mesh.IndexStorage[0];
+		for (int i = 0; i < idxCount; i++) {
+			shortIndices[i] = (GLushort)indices[i];
+		}
+	}
+	else {
+		memcpy(&mesh.IndexStorage[0], indices, sizeof(GLuint) * idxCount);
+	}
+
+	mesh.Vertices = &mesh.VertexStorage[0];
+	mesh.Indices = &mesh.IndexStorage[0];
+	mesh.VertexCount = vertCount;
+	mesh.IndexCount = idxCount;
+	mesh.VertexStride = vertexStride(layout);
+	mesh.IndexSize = indexSize(indexType);
+
+	// BVH for CPU ray picking, built once here rather than per pick
+	buildMeshBVH(mesh.BVH, indexed_vertices, vertCount, indices, idxCount, &scratch);
+}
+
+std::string meshCachePath(const char* file, VertexLayout layout)
+{
+	// Each vertex layout gets its own file so switching layouts doesn't thrash the cache
+	std::string path = file;
+	const size_t extension = path.rfind(".obj");
+	if (extension != std::string::npos)
+		path.erase(extension);
+	return path + (layout == CompactLayout ? ".packed.mesh" : ".mesh");
+}
+
+// Loader thread side of a part : maps its compiled .mesh, or parses the .obj and compiles it
+// for the next start. gMeshLayout is fixed before any load is queued.
+void loadMeshFile(LoadedMesh &mesh, ScratchArena &scratch)
+{
+	const VertexLayout layout = gMeshLayout;
+	const size_t stride = vertexStride(layout);
+	const std::string cachePath = meshCachePath(mesh.File, layout);
+
+	MappedMeshCache &cache = mesh.Cache;
+	if (isMeshCacheStale(mesh.File, cachePath.c_str()) || !mapMeshCache(cachePath.c_str(), stride, cache)) {
+		loadObject((char*)mesh.File, layout, mesh, scratch);
+		if (mesh.Ok)
+			writeMeshCache(cachePath.c_str(), mesh.Vertices, stride, mesh.VertexCount, mesh.Indices, mesh.IndexSize, mesh.IndexCount);
+		return;
+	}
+
+	const size_t vertCount = cache.Header->VertexCount;
+	const size_t idxCount = cache.Header->IndexCount;
+
+	// Staged for the GPU straight from the mapped pages, unmapped once it's in the pool
+	mesh.Mapped = true;
+	mesh.Vertices = cache.Vertices;
+	mesh.Indices = cache.Indices;
+	mesh.VertexCount = vertCount;
+	mesh.IndexCount = idxCount;
+	mesh.VertexStride = stride;
+	mesh.IndexSize = cache.Header->IndexSize;
+
+	// The BVH keeps its own copy of the positions for CPU picking, both layouts start with them
+	glm::vec3* positions = scratchArray<glm::vec3>(scratch, vertCount);
+	for (size_t i = 0; i < vertCount; i++) {
+		const float* position = (const float*)((const char*)cache.Vertices + i * stride);
+		positions[i] = glm::vec3(position[0], position[1], position[2]);
+	}
+	unsigned int* triangleIndices = scratchArray<unsigned int>(scratch, idxCount);
+	if (mesh.IndexSize == sizeof(GLuint))
+		memcpy(triangleIndices, cache.Indices, sizeof(GLuint) * idxCount);
+	else {
+		for (size_t i = 0; i < idxCount; i++)
+			triangleIndices[i] = ((const GLushort*)cache.Indices)[i];
+	}
+	buildMeshBVH(mesh.BVH, positions, vertCount, triangleIndices, idxCount, &scratch);
+	mesh.Ok = true;
+}
+
+// GL thread side : the part's buffers are staged into the pool and freed, its BVH goes into the scene
+void addLoadedMesh(LoadedMesh* mesh)
+{
+	const int ObjectId = mesh->ObjectId;
+	if (!mesh->Ok) {
+		fprintf(stderr, "ERROR: Couldn't load %s\n", mesh->File);
+		releaseLoadedMesh(mesh);
+		return;
+	}
+
+	NumIndices[ObjectId] = mesh->IndexCount;
+	ObjectLayout[ObjectId] = gMeshLayout;
+	VertexBufferSize[ObjectId] = size_t(mesh->VertexStride) * mesh->VertexCount;
+	IndexType[ObjectId] = mesh->IndexSize == sizeof(GLuint) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+	IndexBufferSize[ObjectId] = size_t(mesh->IndexSize) * mesh->IndexCount;
+	std::swap(ObjectBVH[ObjectId], mesh->BVH);
+	PoolMeshIndex[ObjectId] = addPoolMesh(gMeshPool, mesh->Vertices, mesh->VertexCount, mesh->Indices, IndexType[ObjectId], mesh->IndexCount);
+
+	printf("Loaded %s : %u vertices in %.1f ms%s\n", mesh->File, mesh->VertexCount, mesh->Milliseconds, mesh->Mapped ? " (mapped .mesh)" : "");
+	releaseLoadedMesh(mesh);
+}
+
+// Adds whatever the loader finished since the last frame and fences the copies once;
+// with wait, blocks until every queued part is in
+void pollAssetLoads(bool wait)
+{
+	int added = 0;
+	while (LoadedMesh* mesh = wait ? waitLoadedMesh(gAssetLoader) : takeLoadedMesh(gAssetLoader)) {
+		addLoadedMesh(mesh);
+		added++;
+	}
+	if (added == 0)
+		return;
+
+	// The vertex buffer may have been replaced to grow, its layout is described again
+	uploadMeshPool(gMeshPool);
+	setVertexAttributes(gMeshLayout);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	gRedraw = true;
+
+	if (assetLoadsPending(gAssetLoader))
+		return;
+
+	// Selected copies used to be a second upload of every part
+	size_t meshBytes = 0;
+	for (int i = BaseIndex; i < NumObjects; i++)
+		meshBytes += VertexBufferSize[i] + IndexBufferSize[i];
+	printf("All parts loaded in %.1f ms on %d threads\n", (schedulerSeconds() - gLoadStart) * 1000.0, (int)gAssetLoader.Workers.size());
+	printMeshPool(gMeshPool);
+	printf("Mesh buffers : %.1f KB with %d byte vertices, was %.1f KB with separate selected copies\n", meshBytes / 1024.0, (int)vertexStride(gMeshLayout), 2 * meshBytes / 1024.0);
+}
+
+bool benchmarkMeshCache(int count, char* files[])
+{
+	typedef std::chrono::steady_clock Clock;
+	char* defaultFiles[] = { "models/base.obj", "models/arm1.obj", "models/arm2.obj", "models/button.obj",
+							 "models/joint.obj", "models/pen.obj", "models/top.obj" };
+	if (count == 0) {
+		count = 7;
+		files = defaultFiles;
+	}
+
+	const int Repeats = 20;
+	const glm::vec4 color = White;
+	double objTotal = 0.0, cacheTotal = 0.0;
+	bool passed = true;
+
+	printf("Mesh load benchmark : .obj parse + index vs. mapped .mesh, best of %d\n", Repeats);
+	printf("%-24s %10s %12s %12s %9s\n", "file", "vertices", "obj ms", "mesh ms", "speedup");
+
+	for (int f = 0; f < count; f++) {
+		const std::string cachePath = meshCachePath(files[f], LegacyLayout);
+		double objBest = 1e30, cacheBest = 1e30;
+		size_t vertCount = 0;
+		bool loaded = true;
+
+		for (int r = 0; r < Repeats; r++) {
+			// Text path, what createObjects() did for every part at every start
+			Clock::time_point start = Clock::now();
+			std::vector<glm::vec3> vertices, normals, indexed_vertices, indexed_normals;
+			std::vector<unsigned int> indices;
+			if (!loadOBJ(files[f], vertices, normals)) {
+				fprintf(stderr, "ERROR: Couldn't load %s\n", files[f]);
+				loaded = false;
+				break;
+			}
+			indexVBOHashed(vertices, normals, indices, indexed_vertices, indexed_normals);
+			std::vector<GLushort> shortIndices;
+			if (indexed_vertices.size() <= 65536)
+				shortIndices.assign(indices.begin(), indices.end());
+			Vertex* Verts = new Vertex[indexed_vertices.size()];
+			for (size_t i = 0; i < indexed_vertices.size(); i++) {
+				Verts[i].SetPosition(&indexed_vertices[i].x);
+				Verts[i].SetNormal(&indexed_normals[i].x);
+				Verts[i].SetColor((float*)&color[0]);
+			}
+			objBest = glm::min(objBest, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+			vertCount = indexed_vertices.size();
+
+			if (r == 0 && isMeshCacheStale(files[f], cachePath.c_str())) {
+				if (shortIndices.empty())
+					loaded = writeMeshCache(cachePath.c_str(), Verts, sizeof(Vertex), (unsigned int)vertCount, &indices[0], sizeof(GLuint), (unsigned int)indices.size());
+				else
+					loaded = writeMeshCache(cachePath.c_str(), Verts, sizeof(Vertex), (unsigned int)vertCount, &shortIndices[0], sizeof(GLushort), (unsigned int)shortIndices.size());
+			}
+			delete[] Verts;
+			if (!loaded)
+				break;
+
+			// Cached path : map, then read every byte once the way glBufferData would
+			start = Clock::now();
+			MappedMeshCache cache;
+			if (!mapMeshCache(cachePath.c_str(), sizeof(Vertex), cache)) {
+				fprintf(stderr, "ERROR: Could not map mesh cache %s\n", cachePath.c_str());
+				loaded = false;
+				break;
+			}
+			const unsigned char* bytes = (const unsigned char*)cache.Mapping;
+			unsigned int checksum = 0;
+			for (size_t i = 0; i < cache.MappingSize; i++)
+				checksum += bytes[i];
+			unmapMeshCache(cache);
+			cacheBest = glm::min(cacheBest, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+			if (checksum == 0)
+				printf("empty mesh cache %s\n", cachePath.c_str());
+		}
+
+		// The failure is reported above, the totals cover the files that loaded
+		if (!loaded) {
+			passed = false;
+			continue;
+		}
+		objTotal += objBest;
+		cacheTotal += cacheBest;
+		printf("%-24s %10u %12.3f %12.3f %8.1fx\n", files[f], (unsigned int)vertCount, objBest, cacheBest, objBest / cacheBest);
 	}
-	out_Indices = new GLushort[idxCount];
-	for (int i = 0; i < idxCount; i++) {
-		out_Indices[i] = indices[i];
+	printf("%-24s %10s %12.3f %12.3f %8.1fx\n", "total", "", objTotal, cacheTotal, objTotal / cacheTotal);
+	return passed;
+}
+
+// Flat grid of Side x Side quads as an .obj, for loads larger than the bundled parts
+static bool writeSyntheticOBJ(const char* path, int Side)
+{
+	FILE* file = fopen(path, "w");
+	if (file == NULL)
+		return false;
+	for (int z = 0; z <= Side; z++)
+		for (int x = 0; x <= Side; x++)
+			fprintf(file, "v %d 0 %d\n", x, z);
+	fprintf(file, "vn 0 1 0\n");
+	for (int z = 0; z < Side; z++) {
+		for (int x = 0; x < Side; x++) {
+			const int a = z * (Side + 1) + x + 1, b = a + 1, c = a + Side + 2, d = a + Side + 1;
+			fprintf(file, "f %d//1 %d//1 %d//1\nf %d//1 %d//1 %d//1\n", a, c, b, a, d, c);
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+// Heap traffic of one part load : the std::vector temporaries loadObject() used to build
+// (loadOBJ, indexVBOHashed, a new[] vertex array copied into) against its scratch arena, once
+// cold and once reusing the arena of the previous load. Fails when the outputs differ, when the
+// reused arena has to grow, or, in a COUNT_ALLOCATIONS build, when the reused load doesn't make
+// fewer heap allocations than the vector path.
+bool benchmarkLoadAllocations(int count, char* files[])
+{
+	typedef std::chrono::steady_clock Clock;
+	char* defaultFiles[] = { "models/base.obj", "models/arm1.obj", "models/arm2.obj", "models/button.obj",
+							 "models/joint.obj", "models/pen.obj", "models/top.obj" };
+	if (count == 0) {
+		count = 7;
+		files = defaultFiles;
 	}
 
-	// set global variables!!
-	NumIndices[ObjectId] = idxCount;
-	VertexBufferSize[ObjectId] = sizeof(out_Vertices[0]) * vertCount;
-	IndexBufferSize[ObjectId] = sizeof(GLushort) * idxCount;
+	char SyntheticPath[] = "synthetic_grid.obj";
+	std::vector<char*> paths(files, files + count);
+	if (writeSyntheticOBJ(SyntheticPath, 300))
+		paths.push_back(SyntheticPath);
+
+	const VertexLayout layout = gMeshLayout;
+	const size_t stride = vertexStride(layout);
+	bool passed = true;
+
+	printf("Mesh load allocations : vector temporaries vs. scratch arena, %d byte vertices\n", (int)stride);
+	if (!countingAllocations())
+		printf("Heap counts need a build with COUNT_ALLOCATIONS, only outputs and arena growth are checked\n");
+	printf("%-24s %9s | %8s %10s %9s | %8s %10s | %8s %10s %9s | %s\n", "file", "vertices",
+		"vectors", "KB", "ms", "arena", "KB", "reused", "KB", "ms", "output");
+
+	ScratchArena arena;
+	initScratchArena(arena);
+	for (size_t f = 0; f < paths.size(); f++) {
+		// Before : every stage in its own growing vectors
+		startCountingAllocations();
+		Clock::time_point start = Clock::now();
+		std::vector<glm::vec3> vertices, normals, indexed_vertices, indexed_normals;
+		std::vector<unsigned int> indices;
+		if (!loadOBJ(paths[f], vertices, normals)) {
+			stopCountingAllocations();
+			passed = false;
+			continue;
+		}
+		indexVBOHashed(vertices, normals, indices, indexed_vertices, indexed_normals);
+		const size_t vertCount = indexed_vertices.size();
+		unsigned char* Verts = new unsigned char[stride * vertCount];
+		for (size_t i = 0; i < vertCount; i++) {
+			if (layout == CompactLayout) {
+				((CompactVertex*)Verts)[i].SetPosition(&indexed_vertices[i].x);
+				((CompactVertex*)Verts)[i].SetNormal(&indexed_normals[i].x);
+			}
+			else {
+				glm::vec4 color = White;
+				((Vertex*)Verts)[i].SetPosition(&indexed_vertices[i].x);
+				((Vertex*)Verts)[i].SetNormal(&indexed_normals[i].x);
+				((Vertex*)Verts)[i].SetColor(&color[0]);
+			}
+		}
+		MeshBVH bvh;
+		buildMeshBVH(bvh, indexed_vertices, indices);
+		const double vectorMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		const AllocationCounts vectorCounts = stopCountingAllocations();
+
+		// After : a fresh arena, then the same load again on the arena the first one left
+		freeScratchArena(arena);
+		LoadedMesh cold = LoadedMesh();
+		startCountingAllocations();
+		loadObject(paths[f], layout, cold, arena);
+		resetScratchArena(arena);
+		const AllocationCounts coldCounts = stopCountingAllocations();
+
+		LoadedMesh reused = LoadedMesh();
+		const unsigned int blocks = arena.BlockAllocations;
+		startCountingAllocations();
+		start = Clock::now();
+		loadObject(paths[f], layout, reused, arena);
+		const double arenaMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		resetScratchArena(arena);
+		const AllocationCounts reusedCounts = stopCountingAllocations();
+		const bool fewer = arena.BlockAllocations == blocks &&
+			(!countingAllocations() || reusedCounts.Allocations < vectorCounts.Allocations);
+
+		bool same = reused.Ok && reused.VertexCount == vertCount && reused.IndexCount == indices.size() &&
+			memcmp(reused.Vertices, Verts, stride * vertCount) == 0 && reused.BVH.Triangles == bvh.Triangles;
+		for (size_t i = 0; same && i < indices.size(); i++) {
+			const unsigned int index = reused.IndexSize == sizeof(GLuint) ? ((const GLuint*)reused.Indices)[i] : ((const GLushort*)reused.Indices)[i];
+			same = index == indices[i];
+		}
+		passed = passed && same && fewer;
+		delete[] Verts;
+
+		printf("%-24s %9u | %8llu %10.1f %9.3f | %8llu %10.1f | %8llu %10.1f %9.3f | %s\n", paths[f], (unsigned int)vertCount,
+			vectorCounts.Allocations, vectorCounts.Bytes / 1024.0, vectorMs,
+			coldCounts.Allocations, coldCounts.Bytes / 1024.0,
+			reusedCounts.Allocations, reusedCounts.Bytes / 1024.0, arenaMs, !same ? "MISMATCH" : (fewer ? "identical" : "ALLOCATES"));
+	}
+	printf("Scratch arena : %.1f KB high-water mark\n", arena.Peak / 1024.0);
+	freeScratchArena(arena);
+	remove(SyntheticPath);
+
+	printf(passed ? "Load check passed\n" : "Load check FAILED\n");
+	return passed;
 }
 
 void createObjects(void)
@@ -261,60 +868,71 @@ void createObjects(void)
 	//-- .OBJs --//
 
 	// ATTN: load your models here
-	Vertex* Verts;
-	GLushort* Idcs;
-
-	// Load model pieces into space
-
-	// Base Objects
-	loadObject("models/base.obj", glm::vec4(1.0, 0.0, 0.0, 1.0), Verts, Idcs, 2);
-	createVAOs(Verts, Idcs, 2);
-	loadObject("models/arm1.obj", glm::vec4(0.0, 0.0, 1.0, 1.0), Verts, Idcs, 3);
-	createVAOs(Verts, Idcs, 3);
-	loadObject("models/arm2.obj", glm::vec4(0.0, 1.0, 1.0, 1.0), Verts, Idcs, 4);
-	createVAOs(Verts, Idcs, 4);
-	loadObject("models/button.obj", glm::vec4(1.0, 0.0, 0.0, 1.0), Verts, Idcs, 5);
-	createVAOs(Verts, Idcs, 5);
-	loadObject("models/joint.obj", glm::vec4(1.0, 0.0, 1.0, 1.0), Verts, Idcs, 6);
-	createVAOs(Verts, Idcs, 6);
-	loadObject("models/pen.obj", glm::vec4(1.0, 1.0, 0.0, 1.0), Verts, Idcs, 7);
-	createVAOs(Verts, Idcs, 7);
-	loadObject("models/top.obj", glm::vec4(0.0, 1.0, 0.0, 1.0), Verts, Idcs, 8);
-	createVAOs(Verts, Idcs, 8);
-
-	// Selected Objects
-	loadObject("models/base.obj", glm::vec4(1.0, 1.0, 1.0, 1.0), Verts, Idcs, 9);
-	createVAOs(Verts, Idcs, 9);
-	loadObject("models/arm1.obj", glm::vec4(1.0, 1.0, 1.0, 1.0), Verts, Idcs, 10);
-	createVAOs(Verts, Idcs, 10);
-	loadObject("models/arm2.obj", glm::vec4(1.0, 1.0, 1.0, 1.0), Verts, Idcs, 11);
-	createVAOs(Verts, Idcs, 11);
-	loadObject("models/button.obj", glm::vec4(1.0, 1.0, 0.0, 1.0), Verts, Idcs, 12);
-	createVAOs(Verts, Idcs, 12);
-	loadObject("models/joint.obj", glm::vec4(1.0, 1.0, 1.0, 1.0), Verts, Idcs, 13);
-	createVAOs(Verts, Idcs, 13);
-	loadObject("models/pen.obj", glm::vec4(1.0, 1.0, 1.0, 1.0), Verts, Idcs, 14);
-	createVAOs(Verts, Idcs, 14);
-	loadObject("models/top.obj", glm::vec4(1.0, 1.0, 1.0, 1.0), Verts, Idcs, 15);
-	createVAOs(Verts, Idcs, 15);
-
+	// Compiled .mesh files next to the .obj are mapped and uploaded directly,
+	// they are rebuilt from the .obj whenever it is newer
+
+	// The pool starts out empty, so the window comes up straight away and
+	// pollAssetLoads() adds the parts as the workers finish them
+	initMeshPool(gMeshPool, vertexStride(gMeshLayout));
+	uploadMeshPool(gMeshPool);
+	setVertexAttributes(gMeshLayout);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Base Objects, drawn with ObjectColor or SelectedColor
+	gLoadStart = schedulerSeconds();
+	startAssetLoader(gAssetLoader, loadMeshFile, gLoaderThreads);
+	queueMeshLoad(gAssetLoader, "models/base.obj", BaseIndex);
+	queueMeshLoad(gAssetLoader, "models/arm1.obj", Arm1Index);
+	queueMeshLoad(gAssetLoader, "models/arm2.obj", Arm2Index);
+	queueMeshLoad(gAssetLoader, "models/button.obj", ButtonIndex);
+	queueMeshLoad(gAssetLoader, "models/joint.obj", JointIndex);
+	queueMeshLoad(gAssetLoader, "models/pen.obj", PenIndex);
+	queueMeshLoad(gAssetLoader, "models/top.obj", TopIndex);
 }
 
 void deselectObjectIndicies() {
-	BaseIndex = 2;
-	Arm1Index = 3;
-	Arm2Index = 4;
-	ButtonIndex = 5;
-	JointIndex = 6;
-	PenIndex = 7;
-	TopIndex = 8;
+	for (int i = 0; i < NumObjects; i++)
+		ObjectSelected[i] = false;
 }
 
 void renderScene(void)
+{
+	beginCpuTimer(gProfiler, RenderTimer);
+
+	// Hand over any picks whose readback finished since the last frame
+	pollAsyncPicks(gAsyncPicker);
+	pollAssetLoads(false);
+	collectGpuTimers(gProfiler);
+
+	drawScene();
+	endCpuTimer(gProfiler, RenderTimer);
+
+	beginCpuTimer(gProfiler, PresentTimer);
+	// Draw GUI
+	beginGpuTimer(gProfiler, GuiPassTimer);
+	TwDraw();
+	endGpuTimer(gProfiler, GuiPassTimer);
+
+	// Swap buffers
+	glfwSwapBuffers(window);
+	endCpuTimer(gProfiler, PresentTimer);
+	glfwPollEvents();
+}
+
+// The scene pass alone, into whatever framebuffer is bound
+void drawScene(void)
 {
 	// Update camera view based on arrow key movement
 	gViewMatrix = glm::lookAt(setLookat(), glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, 1.0, 0.0));
 
+	// Only joints that moved since the last frame are recomputed
+	updateRigNodes();
+	updatePoolInstances();
+	updateFrameUniforms();
+
+	beginGpuTimer(gProfiler, ScenePassTimer);
+
 	// Dark blue background
 	glClearColor(0.0f, 0.0f, 0.2f, 0.0f);
 	// Re-clear the screen for real rendering
@@ -322,190 +940,93 @@ void renderScene(void)
 
 	glUseProgram(programID);
 	{
-		glm::vec3 lightPos = glm::vec3(4, 4, 4);
-		glm::vec3 lightPos2 = glm::vec3(-4, 4, -4);
-
-		glm::mat4x4 ModelMatrix = glm::mat4(1.0);
-
-		glUniform3f(LightID, lightPos.x, lightPos.y, lightPos.z);
-		glUniform3f(LightID2, lightPos2.x, lightPos2.y, lightPos2.z);
-
-		glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &gViewMatrix[0][0]);
-		glUniformMatrix4fv(ProjMatrixID, 1, GL_FALSE, &gProjectionMatrix[0][0]);
-		glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
+		// Camera and lights are already bound for the frame
+		bindUniforms(gUniforms, ObjectBlockBinding, StaticObjectOffset, sizeof(ObjectUniforms));
 
 		// Draw XYZ coordinates axes
 		glBindVertexArray(VertexArrayId[0]);
+		recordDrawArrays(gDrawStats, ObjectNames[0], GL_LINES, 0, 6, 1);
+		gDrawStats.Frame.Submissions++;
 		glDrawArrays(GL_LINES, 0, 6);
 
 		// Draw Grid
 		glBindVertexArray(VertexArrayId[1]);
+		recordDrawArrays(gDrawStats, ObjectNames[1], GL_LINES, 0, 44, 1);
+		gDrawStats.Frame.Submissions++;
 		glDrawArrays(GL_LINES, 0, 44);
 
-		// Translate Objects to Correct Positions
-		// Base
-		glBindVertexArray(VertexArrayId[BaseIndex]);
-		translateObjectMatrix(&BaseModelMatrix, ModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		translateObjectMatrix(&BaseModelMatrix, BaseModelMatrix, glm::vec3(0.0f + BaseXPosition, 0.5f, 0.0f + BaseZPosition));
-		glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &BaseModelMatrix[0][0]);
-		glDrawElements(GL_TRIANGLES, VertexBufferSize[BaseIndex], GL_UNSIGNED_SHORT, 0);
-
-		// Top
-		glBindVertexArray(VertexArrayId[TopIndex]);
-		translateObjectMatrix(&TopModelMatrix, BaseModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		rotateObjectMatrix(&TopModelMatrix, TopModelMatrix, TopYRotation, glm::vec3(0.0f, 1.0f, 0.0f));
-		translateObjectMatrix(&TopModelMatrix, TopModelMatrix, glm::vec3(0.0f, 0.75f, 0.0f));
-		glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &TopModelMatrix[0][0]);
-		glDrawElements(GL_TRIANGLES, VertexBufferSize[TopIndex], GL_UNSIGNED_SHORT, 0);
-
-		// Arm1
-		glBindVertexArray(VertexArrayId[Arm1Index]);
-		translateObjectMatrix(&Arm1ModelMatrix, TopModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		rotateObjectMatrix(&Arm1ModelMatrix, Arm1ModelMatrix, float((-1) * PI / 4) + Arm1ZRotation, glm::vec3(0.0f, 0.0f, 1.0f));
-		translateObjectMatrix(&Arm1ModelMatrix, Arm1ModelMatrix, glm::vec3(0.0f, 0.75f, 0.0f));
-		glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &Arm1ModelMatrix[0][0]);
-		glDrawElements(GL_TRIANGLES, VertexBufferSize[Arm1Index], GL_UNSIGNED_SHORT, 0);
-
-		// Joint
-		glBindVertexArray(VertexArrayId[JointIndex]);
-		translateObjectMatrix(&JointModelMatrix, Arm1ModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		scaleObjectMatrix(&JointModelMatrix, JointModelMatrix, glm::vec3(0.65f));
-		translateObjectMatrix(&JointModelMatrix, JointModelMatrix, glm::vec3(0.0f, 2.05f, 0.0f));
-		glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &JointModelMatrix[0][0]);
-		glDrawElements(GL_TRIANGLES, VertexBufferSize[JointIndex], GL_UNSIGNED_SHORT, 0);
-
-		// Arm2
-		glBindVertexArray(VertexArrayId[Arm2Index]);
-		translateObjectMatrix(&Arm2ModelMatrix, JointModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		scaleObjectMatrix(&Arm2ModelMatrix, Arm2ModelMatrix, glm::vec3(2.0f));
-		rotateObjectMatrix(&Arm2ModelMatrix, Arm2ModelMatrix, float((-1) * PI / 2.5) + Arm2ZRotation, glm::vec3(0.0f, 0.0f, 1.0f));
-		translateObjectMatrix(&Arm2ModelMatrix, Arm2ModelMatrix, glm::vec3(0.0f, 0.5f, 0.0f));
-		glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &Arm2ModelMatrix[0][0]);
-		glDrawElements(GL_TRIANGLES, VertexBufferSize[Arm2Index], GL_UNSIGNED_SHORT, 0);
-
-		// Pen
-		glBindVertexArray(VertexArrayId[PenIndex]);
-		translateObjectMatrix(&PenModelMatrix, Arm2ModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		rotateObjectMatrix(&PenModelMatrix, PenModelMatrix, float(2 * PI / 4), glm::vec3(0.0f, 0.0f, 1.0f));
-		translateObjectMatrix(&PenModelMatrix, PenModelMatrix, glm::vec3(0.6f, 0.0f, 0.0f));
-		rotateObjectMatrix(&PenModelMatrix, PenModelMatrix, PenXRotation, glm::vec3(1.0f, 0.0f, 0.0f));
-		rotateObjectMatrix(&PenModelMatrix, PenModelMatrix, PenZRotation, glm::vec3(0.0f, 0.0f, 1.0f));
-		translateObjectMatrix(&PenModelMatrix, PenModelMatrix, glm::vec3(0.0f, 0.2f, 0.0f));
-		rotateObjectMatrix(&PenModelMatrix, PenModelMatrix, PenYRotation, glm::vec3(0.0f, 1.0f, 0.0f));
-		glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &PenModelMatrix[0][0]);
-		glDrawElements(GL_TRIANGLES, VertexBufferSize[PenIndex], GL_UNSIGNED_SHORT, 0);
-
-
-		// Button
-		glBindVertexArray(VertexArrayId[ButtonIndex]);
-		translateObjectMatrix(&ButtonModelMatrix, PenModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		translateObjectMatrix(&ButtonModelMatrix, ButtonModelMatrix, glm::vec3(0.05f, 0.0f, 0.0f));
-		glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ButtonModelMatrix[0][0]);
-		glDrawElements(GL_TRIANGLES, VertexBufferSize[ButtonIndex], GL_UNSIGNED_SHORT, 0);
-
 		glBindVertexArray(0);
 
+		// Every part of every rig in one submission, M and the material come from the instance attributes
+		bindUniforms(gUniforms, ObjectBlockBinding, InstancedObjectOffset, sizeof(ObjectUniforms));
+		drawMeshPool(gMeshPool, gPoolCommands, gPoolCommandCount, gDrawStats, "rig parts");
+
 	}
 	glUseProgram(0);
-	// Draw GUI
-	TwDraw();
+	endGpuTimer(gProfiler, ScenePassTimer);
+}
 
-	// Swap buffers
-	glfwSwapBuffers(window);
-	glfwPollEvents();
+void updateFrameUniforms(void)
+{
+	FrameUniforms frame;
+	frame.V = gViewMatrix;
+	frame.P = gProjectionMatrix;
+	frame.LightPosition = gViewMatrix * glm::vec4(4, 4, 4, 1);
+	frame.LightPosition2 = gViewMatrix * glm::vec4(-4, 4, -4, 1);
+
+	// Axes and grid sit at the origin
+	ObjectUniforms object;
+	memset(&object, 0, sizeof(object));
+	glm::mat3 NormalMatrix;
+	computeObjectConstants(glm::mat4(1.0), gViewMatrix, gProjectionMatrix * gViewMatrix, object.MVP, object.MV, NormalMatrix);
+	for (int column = 0; column < 3; column++)
+		object.NormalMatrix[column] = glm::vec4(NormalMatrix[column], 0.0f);
+	object.MaterialColor = White;
+	object.PickingColor = 1.0f;		// background
+
+	beginUniformRing(gUniforms);
+	FrameBlockOffset = pushUniforms(gUniforms, &frame, sizeof(frame));
+	StaticObjectOffset = pushUniforms(gUniforms, &object, sizeof(object));
+	object.UseInstanceMatrix = 1;
+	InstancedObjectOffset = pushUniforms(gUniforms, &object, sizeof(object));
+	uploadUniformRing(gUniforms);
+
+	// Bindings are context state, the frame block stays bound for every program
+	bindUniforms(gUniforms, FrameBlockBinding, FrameBlockOffset, sizeof(FrameUniforms));
 }
 
-void pickObject(void)
+void drawPickingPass(void)
 {
 	// Clear the screen in white
 	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	beginGpuTimer(gProfiler, PickPassTimer);
 	glUseProgram(pickingProgramID);
 	{
-		glm::mat4 ModelMatrix = glm::mat4(1.0); // TranslationMatrix * RotationMatrix;
-		glm::mat4 MVP = gProjectionMatrix * gViewMatrix * ModelMatrix;
-
-		// Send our transformation to the currently bound shader, in the "MVP" uniform
-		glUniformMatrix4fv(PickingMatrixID, 1, GL_FALSE, &MVP[0][0]);
-		
-		// Base
-		glBindVertexArray(VertexArrayId[BaseIndex]);
-		translateObjectMatrix(&BaseModelMatrix, ModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		translateObjectMatrix(&BaseModelMatrix, BaseModelMatrix, glm::vec3(0.0f + BaseXPosition, 0.5f, 0.0f + BaseZPosition));
-		MVP = gProjectionMatrix * gViewMatrix * BaseModelMatrix;
-		glUniformMatrix4fv(PickingMatrixID, 1, GL_FALSE, &MVP[0][0]);
-		glUniform1f(pickingColorID, BaseIndex / 255.0f);
-		glDrawElements(GL_TRIANGLES, VertexBufferSize[BaseIndex], GL_UNSIGNED_SHORT, 0);
-
-		// Top
-		glBindVertexArray(VertexArrayId[TopIndex]);
-		translateObjectMatrix(&TopModelMatrix, BaseModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		rotateObjectMatrix(&TopModelMatrix, TopModelMatrix, TopYRotation, glm::vec3(0.0f, 1.0f, 0.0f));
-		translateObjectMatrix(&TopModelMatrix, TopModelMatrix, glm::vec3(0.0f, 0.75f, 0.0f));
-		MVP = gProjectionMatrix * gViewMatrix * TopModelMatrix;
-		glUniformMatrix4fv(PickingMatrixID, 1, GL_FALSE, &MVP[0][0]);
-		glUniform1f(pickingColorID, TopIndex / 255.0f);
-		glDrawElements(GL_TRIANGLES, VertexBufferSize[TopIndex], GL_UNSIGNED_SHORT, 0);
-
-		// Arm1
-		glBindVertexArray(VertexArrayId[Arm1Index]);
-		translateObjectMatrix(&Arm1ModelMatrix, TopModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		rotateObjectMatrix(&Arm1ModelMatrix, Arm1ModelMatrix, float((-1) * PI / 4) + Arm1ZRotation, glm::vec3(0.0f, 0.0f, 1.0f));
-		translateObjectMatrix(&Arm1ModelMatrix, Arm1ModelMatrix, glm::vec3(0.0f, 0.75f, 0.0f));
-		MVP = gProjectionMatrix * gViewMatrix * Arm1ModelMatrix;
-		glUniformMatrix4fv(PickingMatrixID, 1, GL_FALSE, &MVP[0][0]);
-		glUniform1f(pickingColorID, Arm1Index / 255.0f);
-		glDrawElements(GL_TRIANGLES, VertexBufferSize[Arm1Index], GL_UNSIGNED_SHORT, 0);
-
-		// Joint
-		glBindVertexArray(VertexArrayId[JointIndex]);
-		translateObjectMatrix(&JointModelMatrix, Arm1ModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		scaleObjectMatrix(&JointModelMatrix, JointModelMatrix, glm::vec3(0.65f));
-		translateObjectMatrix(&JointModelMatrix, JointModelMatrix, glm::vec3(0.0f, 2.05f, 0.0f));
-		MVP = gProjectionMatrix * gViewMatrix * JointModelMatrix;
-		glUniformMatrix4fv(PickingMatrixID, 1, GL_FALSE, &MVP[0][0]);
-		glUniform1f(pickingColorID, JointIndex / 255.0f);
-		glDrawElements(GL_TRIANGLES, VertexBufferSize[JointIndex], GL_UNSIGNED_SHORT, 0);
-
-		// Arm2
-		glBindVertexArray(VertexArrayId[Arm2Index]);
-		translateObjectMatrix(&Arm2ModelMatrix, JointModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		scaleObjectMatrix(&Arm2ModelMatrix, Arm2ModelMatrix, glm::vec3(2.0f));
-		rotateObjectMatrix(&Arm2ModelMatrix, Arm2ModelMatrix, float((-1) * PI / 2.5) + Arm2ZRotation, glm::vec3(0.0f, 0.0f, 1.0f));
-		translateObjectMatrix(&Arm2ModelMatrix, Arm2ModelMatrix, glm::vec3(0.0f, 0.5f, 0.0f));
-		MVP = gProjectionMatrix * gViewMatrix * Arm2ModelMatrix;
-		glUniformMatrix4fv(PickingMatrixID, 1, GL_FALSE, &MVP[0][0]);
-		glUniform1f(pickingColorID, Arm2Index / 255.0f);
-		glDrawElements(GL_TRIANGLES, VertexBufferSize[Arm2Index], GL_UNSIGNED_SHORT, 0);
-
-		// Pen
-		glBindVertexArray(VertexArrayId[PenIndex]);
-		translateObjectMatrix(&PenModelMatrix, Arm2ModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		rotateObjectMatrix(&PenModelMatrix, PenModelMatrix, float(2 * PI / 4), glm::vec3(0.0f, 0.0f, 1.0f));
-		translateObjectMatrix(&PenModelMatrix, PenModelMatrix, glm::vec3(0.6f, 0.0f, 0.0f));
-		rotateObjectMatrix(&PenModelMatrix, PenModelMatrix, PenXRotation, glm::vec3(1.0f, 0.0f, 0.0f));
-		rotateObjectMatrix(&PenModelMatrix, PenModelMatrix, PenZRotation, glm::vec3(0.0f, 0.0f, 1.0f));
-		translateObjectMatrix(&PenModelMatrix, PenModelMatrix, glm::vec3(0.0f, 0.2f, 0.0f));
-		rotateObjectMatrix(&PenModelMatrix, PenModelMatrix, PenYRotation, glm::vec3(0.0f, 1.0f, 0.0f));
-		MVP = gProjectionMatrix * gViewMatrix * PenModelMatrix;
-		glUniformMatrix4fv(PickingMatrixID, 1, GL_FALSE, &MVP[0][0]);
-		glUniform1f(pickingColorID, PenIndex / 255.0f);
-		glDrawElements(GL_TRIANGLES, VertexBufferSize[PenIndex], GL_UNSIGNED_SHORT, 0);
-
-
-		// Button
-		glBindVertexArray(VertexArrayId[ButtonIndex]);
-		translateObjectMatrix(&ButtonModelMatrix, PenModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		translateObjectMatrix(&ButtonModelMatrix, ButtonModelMatrix, glm::vec3(0.05f, 0.0f, 0.0f));
-		MVP = gProjectionMatrix * gViewMatrix * ButtonModelMatrix;
-		glUniformMatrix4fv(PickingMatrixID, 1, GL_FALSE, &MVP[0][0]);
-		glUniform1f(pickingColorID, ButtonIndex / 255.0f);
-		glDrawElements(GL_TRIANGLES, VertexBufferSize[ButtonIndex], GL_UNSIGNED_SHORT, 0);
-
-		glBindVertexArray(0);
+		// The instance buffer and uniform ring still hold this frame's matrices and picking IDs;
+		// IDs identify the part, not the rig
+		bindUniforms(gUniforms, ObjectBlockBinding, InstancedObjectOffset, sizeof(ObjectUniforms));
+		drawMeshPool(gMeshPool, gPoolCommands, gPoolCommandCount, gDrawStats, "picking rig parts");
 	}
 	glUseProgram(0);
+	endGpuTimer(gProfiler, PickPassTimer);
+}
+
+void pickObject(double xpos, double ypos)
+{
+	selectPickedObject(pickObjectAt(xpos, ypos));
+
+	// Uncomment these lines to see the picking shader in effect
+	//glfwSwapBuffers(window);
+	//continue; // skips the normal rendering
+}
+
+// Synchronous color-ID pick at a cursor position, returns the object index (255 is the background)
+int pickObjectAt(double xpos, double ypos)
+{
+	drawPickingPass();
+
 	// Wait until all the pending drawing commands are really done.
 	// Ultra-mega-over slow ! 
 	// There are usually a long time between glDrawElements() and
@@ -519,14 +1040,58 @@ void pickObject(void)
 	// You can also use glfwGetMousePos().
 	// Ultra-mega-over slow too, even for 1 pixel, 
 	// because the framebuffer is on the GPU.
-	double xpos, ypos;
-	glfwGetCursorPos(window, &xpos, &ypos);
 	unsigned char data[4];
 	glReadPixels(xpos, window_height - ypos, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, data); // OpenGL renders with (0,0) on bottom, mouse reports with (0,0) on top
 
 	// Convert the color back to an integer ID
-	gPickedIndex = int(data[0]);
-	
+	return int(data[0]);
+}
+
+void pickObjectAsync(double xpos, double ypos)
+{
+	// All readback slots still in flight, drop the click rather than stall
+	if (!beginAsyncPick(gAsyncPicker))
+		return;
+
+	drawPickingPass();
+
+	// The result arrives through selectPickedObject() once the fence has signaled
+	endAsyncPick(gAsyncPicker, int(xpos), int(window_height - ypos));
+}
+
+int pickObjectRay(double xpos, double ypos, RayHit &hit)
+{
+	// Unproject the cursor onto the near and far planes (mouse reports with (0,0) on top)
+	const glm::vec4 viewport = glm::vec4(0.0f, 0.0f, window_width, window_height);
+	const float winY = float(window_height - ypos);
+	const glm::vec3 nearPoint = glm::unProject(glm::vec3(float(xpos), winY, 0.0f), gViewMatrix, gProjectionMatrix, viewport);
+	const glm::vec3 farPoint = glm::unProject(glm::vec3(float(xpos), winY, 1.0f), gViewMatrix, gProjectionMatrix, viewport);
+
+	// The segment is mapped into each part's model space; an affine map keeps the ray
+	// parameter, so hit distances stay comparable between parts without renormalizing
+	int pickedIndex = 255;
+	hit.Distance = 1.0f;
+	hit.Triangle = -1;
+	hit.U = hit.V = 0.0f;
+
+	for (int i = 0; i < NumRigParts; i++) {
+		const unsigned int ObjectIndex = RigParts[i].ObjectIndex;
+		const glm::mat4 toModel = glm::inverse(gScene.World[RigParts[i].Node]);
+		const glm::vec3 origin = glm::vec3(toModel * glm::vec4(nearPoint, 1.0f));
+		const glm::vec3 end = glm::vec3(toModel * glm::vec4(farPoint, 1.0f));
+
+		if (intersectMeshBVH(ObjectBVH[ObjectIndex], origin, end - origin, hit))
+			pickedIndex = ObjectIndex;
+	}
+
+	return pickedIndex;
+}
+
+void selectPickedObject(int pickedIndex)
+{
+	gPickedIndex = pickedIndex;
+	gRedraw = true;
+
 	if (gPickedIndex == 255){ // Full white, must be the background !
 		gMessage = "background";
 	}
@@ -537,72 +1102,93 @@ void pickObject(void)
 				oss << "Base";
 				deselectObjectIndicies();
 				keyMode = 5;
-				BaseIndex = 9;
+				ObjectSelected[BaseIndex] = true;
 				break;
 			case 3:
 				oss << "Arm1";
 				deselectObjectIndicies();
 				keyMode = 1;
-				Arm1Index = 10;
+				ObjectSelected[Arm1Index] = true;
 				break;
 			case 4:
 				oss << "Arm2";
 				deselectObjectIndicies();
 				keyMode = 2;
-				Arm2Index = 11;
+				ObjectSelected[Arm2Index] = true;
 				break;
 			case 5:
 				oss << "Button";
 				deselectObjectIndicies();
-				ButtonIndex = 12;
+				ObjectSelected[ButtonIndex] = true;
 				break;
 			case 6:
 				oss << "Joint";
 				deselectObjectIndicies();
-				JointIndex = 13;
+				ObjectSelected[JointIndex] = true;
 				break;
 			case 7:
 				oss << "Pen";
 				deselectObjectIndicies();
 				keyMode = 4;
-				PenIndex = 14;
+				ObjectSelected[PenIndex] = true;
 				break;
 			case 8:
 				oss << "Top";
 				deselectObjectIndicies();
 				keyMode = 6;
-				TopIndex = 15;
-				break;
-			case 9:
-				oss << "Base";
-				break;
-			case 10:
-				oss << "Arm1";
-				break;
-			case 11:
-				oss << "Arm2";
-				break;
-			case 12:
-				oss << "Button";
-				break;
-			case 13:
-				oss << "Joint";
-				break;
-			case 14:
-				oss << "Pen";
-				break;
-			case 15:
-				oss << "Top";
+				ObjectSelected[TopIndex] = true;
 				break;
 			default:
 				oss << "point " << gPickedIndex;
 		}
 		gMessage = oss.str();
 	}
+}
 
-	// Uncomment these lines to see the picking shader in effect
-	//glfwSwapBuffers(window);
-	//continue; // skips the normal rendering
+void initProfiler(void)
+{
+	initFrameProfiler(gProfiler);
+	FrameTimer = addCpuTimer(gProfiler, "Frame");
+	UpdateTimer = addCpuTimer(gProfiler, "Update");
+	RenderTimer = addCpuTimer(gProfiler, "Render");
+	PickTimer = addCpuTimer(gProfiler, "Picking");
+	PresentTimer = addCpuTimer(gProfiler, "GUI + swap");
+	ScenePassTimer = addGpuTimer(gProfiler, "GPU scene");
+	PickPassTimer = addGpuTimer(gProfiler, "GPU picking");
+	GuiPassTimer = addGpuTimer(gProfiler, "GPU GUI");
+	DrawCallCounter = addCounter(gProfiler, "Draw calls");
+	MeshDrawCounter = addCounter(gProfiler, "Meshes drawn");
+	TriangleCounter = addCounter(gProfiler, "Triangles");
+	VertexCounter = addCounter(gProfiler, "Vertices");
+	IkIterationCounter = addCounter(gProfiler, "IK iterations");
+	IkTimeCounter = addCounter(gProfiler, "IK us/target");
+	IkMissedCounter = addCounter(gProfiler, "IK missed");
+	createProfilerQueries(gProfiler);
+}
+
+// Hands the frame's geometry totals to the profiler counters
+void endFrameStats(void)
+{
+	endDrawFrame(gDrawStats);
+	setCounter(gProfiler, DrawCallCounter, gDrawStats.Last.Submissions);
+	setCounter(gProfiler, MeshDrawCounter, gDrawStats.Last.Draws);
+	setCounter(gProfiler, TriangleCounter, (double)gDrawStats.Last.Triangles);
+	setCounter(gProfiler, VertexCounter, (double)gDrawStats.Last.Vertices);
+
+	// Per target averages, 0 on frames that traced nothing
+	setCounter(gProfiler, IkIterationCounter, gIkTargets > 0 ? gIkIterations / gIkTargets : 0.0);
+	setCounter(gProfiler, IkTimeCounter, gIkTargets > 0 ? gIkSeconds * 1e6 / gIkTargets : 0.0);
+	setCounter(gProfiler, IkMissedCounter, gIkMissed);
+	gIkTargets = 0;
+	gIkMissed = 0;
+	gIkIterations = 0.0;
+	gIkSeconds = 0.0;
+}
+
+static void TW_CALL dumpProfile(void *clientData)
+{
+	if (writeProfileCSV(gProfiler, "frame_stats.csv") && writeProfileJSON(gProfiler, "frame_stats.json"))
+		printf("Frame stats written to frame_stats.csv and frame_stats.json\n");
 }
 
 int initWindow(void)
@@ -640,11 +1226,28 @@ int initWindow(void)
 	TwBar * GUI = TwNewBar("Picking");
 	TwSetParam(GUI, NULL, "refresh", TW_PARAM_CSTRING, 1, "0.1");
 	TwAddVarRW(GUI, "Last picked object", TW_TYPE_STDSTRING, &gMessage, NULL);
+	TwAddVarRW(GUI, "Async picking", TW_TYPE_BOOLCPP, &gAsyncPicking, NULL);
+	TwAddVarRW(GUI, "Ray picking", TW_TYPE_BOOLCPP, &gRayPicking, NULL);
+	TwAddVarRO(GUI, "Hovered object", TW_TYPE_STDSTRING, &gHoverMessage, NULL);
+	TwAddVarRW(GUI, "Rigs", TW_TYPE_INT32, &gRigCount, " min=1 max=100000 ");
+	TwAddVarRW(GUI, "Render on demand", TW_TYPE_BOOLCPP, &gRenderOnDemand, NULL);
+
+	// Frame timers, min / avg / p99 over the last ProfileWindow samples
+	initProfiler();
+	TwBar * Perf = TwNewBar("Performance");
+	TwDefine(" Performance position='232 16' size='300 300' valueswidth=170 ");
+	TwSetParam(Perf, NULL, "refresh", TW_PARAM_CSTRING, 1, "0.5");
+	for (int i = 0; i < gProfiler.NumTimers; i++)
+		TwAddVarRO(Perf, gProfiler.Timers[i].Name, TW_TYPE_STDSTRING, &gProfiler.Timers[i].Summary, NULL);
+	TwAddVarRW(Perf, "Validate draws", TW_TYPE_BOOLCPP, &gDrawStats.Validate, NULL);
+	TwAddButton(Perf, "Dump stats", dumpProfile, NULL, NULL);
 
 	// Set up inputs
 	glfwSetCursorPos(window, window_width / 2, window_height / 2);
 	glfwSetKeyCallback(window, keyCallback);
 	glfwSetMouseButtonCallback(window, mouseCallback);
+	glfwSetCursorPosCallback(window, cursorCallback);
+	glfwSetWindowRefreshCallback(window, refreshCallback);
 
 	return 0;
 }
@@ -659,7 +1262,7 @@ void initOpenGL(void)
 	// Cull triangles which normal is not towards the camera
 	glEnable(GL_CULL_FACE);
 
-	// Projection matrix : 45 Field of View, 4:3 ratio, display range : 0.1 unit <-> 100 units
+	// Projection matrix : 45� Field of View, 4:3 ratio, display range : 0.1 unit <-> 100 units
 	gProjectionMatrix = glm::perspective(45.0f, 4.0f / 3.0f, 0.1f, 100.0f);
 	// Or, for an ortho camera :
 	//gProjectionMatrix = glm::ortho(-4.0f, 4.0f, -3.0f, 3.0f, 0.0f, 100.0f); // In world coordinates
@@ -673,28 +1276,33 @@ void initOpenGL(void)
 	programID = LoadShaders("StandardShading.vertexshader", "StandardShading.fragmentshader");
 	pickingProgramID = LoadShaders("Picking.vertexshader", "Picking.fragmentshader");
 
-	// Get a handle for our "MVP" uniform
-	MatrixID = glGetUniformLocation(programID, "MVP");
-	ModelMatrixID = glGetUniformLocation(programID, "M");
-	ViewMatrixID = glGetUniformLocation(programID, "V");
-	ProjMatrixID = glGetUniformLocation(programID, "P");
-	
-	PickingMatrixID = glGetUniformLocation(pickingProgramID, "MVP");
-	// Get a handle for our "pickingColorID" uniform
-	pickingColorID = glGetUniformLocation(pickingProgramID, "PickingColor");
-	// Get a handle for our "LightPosition" uniform
-	LightID = glGetUniformLocation(programID, "LightPosition_worldspace");
-	LightID2 = glGetUniformLocation(programID, "LightPosition_worldspace2");
+	// GLSL 330 can't assign block bindings itself; the picking program only has an ObjectBlock
+	const GLuint programs[] = { programID, pickingProgramID };
+	const char* blocks[] = { "FrameBlock", "ObjectBlock" };
+	const GLuint bindings[] = { FrameBlockBinding, ObjectBlockBinding };
+	for (int i = 0; i < 2; i++) {
+		for (int b = 0; b < 2; b++) {
+			const GLuint block = glGetUniformBlockIndex(programs[i], blocks[b]);
+			if (block != GL_INVALID_INDEX)
+				glUniformBlockBinding(programs[i], block, bindings[b]);
+		}
+	}
+	createUniformRing(gUniforms, 64 * 1024);
+
+	// Compact meshes have no color array, they read this generic value (context state, not per VAO)
+	glVertexAttrib4f(1, 1.0f, 1.0f, 1.0f, 1.0f);
 
 	createObjects();
+	createRigNodes();
+
+	// Fall back to the synchronous readback if the offscreen target can't be built
+	if (!createAsyncPicker(gAsyncPicker, window_width, window_height, selectPickedObject))
+		gAsyncPicking = false;
 }
 
-void createVAOs(Vertex Vertices[], unsigned short Indices[], int ObjectId) {
+void createVAOs(const GLvoid* Vertices, const GLvoid* Indices, int ObjectId) {
 
 	GLenum ErrorCheckValue = glGetError();
-	const size_t VertexSize = sizeof(Vertices[0]);
-	const size_t RgbOffset = sizeof(Vertices[0].Position);
-	const size_t Normaloffset = sizeof(Vertices[0].Color) + RgbOffset;
 
 	// Create Vertex Array Object
 	glGenVertexArrays(1, &VertexArrayId[ObjectId]);	//
@@ -713,13 +1321,7 @@ void createVAOs(Vertex Vertices[], unsigned short Indices[], int ObjectId) {
 	}
 
 	// Assign vertex attributes
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, VertexSize, 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, VertexSize, (GLvoid*)RgbOffset); 
-	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, VertexSize, (GLvoid*)Normaloffset);
-
-	glEnableVertexAttribArray(0);	// position
-	glEnableVertexAttribArray(1);	// color
-	glEnableVertexAttribArray(2);	// normal
+	setVertexAttributes(ObjectLayout[ObjectId]);
 
 	// Disable our Vertex Buffer Object 
 	glBindVertexArray(0);
@@ -735,6 +1337,140 @@ void createVAOs(Vertex Vertices[], unsigned short Indices[], int ObjectId) {
 	}
 }
 
+// Attributes 0-2 of the bound VAO, read from the bound GL_ARRAY_BUFFER
+void setVertexAttributes(VertexLayout layout)
+{
+	const size_t VertexSize = vertexStride(layout);
+	const size_t RgbOffset = offsetof(Vertex, Color);
+	const size_t Normaloffset = offsetof(Vertex, Normal);
+	const size_t PackedNormalOffset = offsetof(CompactVertex, Normal);
+
+	if (layout == CompactLayout) {
+		// No color array : attribute 1 reads the constant set in initOpenGL()
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VertexSize, 0);
+		glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, VertexSize, (GLvoid*)PackedNormalOffset);
+
+		glEnableVertexAttribArray(0);	// position
+		glEnableVertexAttribArray(2);	// normal
+	}
+	else {
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, VertexSize, 0);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, VertexSize, (GLvoid*)RgbOffset);
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, VertexSize, (GLvoid*)Normaloffset);
+
+		glEnableVertexAttribArray(0);	// position
+		glEnableVertexAttribArray(1);	// color
+		glEnableVertexAttribArray(2);	// normal
+	}
+}
+
+// Per-object vertex constants, once here rather than for every vertex in the shader.
+// The normal matrix keeps normals perpendicular under the scaled Joint and Arm2.
+void computeObjectConstants(const glm::mat4 &M, const glm::mat4 &V, const glm::mat4 &VP, glm::mat4 &MVP, glm::mat4 &MV, glm::mat3 &NormalMatrix)
+{
+	MVP = VP * M;
+	MV = V * M;
+	NormalMatrix = glm::inverseTranspose(glm::mat3(MV));
+}
+
+// Adds or removes followers from the end, so the rigs that stay keep their dense index,
+// then lays every rig out again on a square grid around the driven one at the origin
+void resizeStressRigs(int count)
+{
+	if ((int)gStressRigs.size() == count)
+		return;
+	while ((int)gStressRigs.size() < count)
+		gStressRigs.push_back(addRig(gWorld, ArmLimits, 0.0f, 0.0f));
+	while ((int)gStressRigs.size() > count) {
+		removeRig(gWorld, gStressRigs.back());
+		gStressRigs.pop_back();
+	}
+
+	const int side = (int)ceil(sqrt((double)rigCount(gWorld)));
+	for (int r = 0; r < rigCount(gWorld); r++) {
+		gWorld.Rigs.RootX[r] = RigSpacing * (r % side);
+		gWorld.Rigs.RootZ[r] = RigSpacing * (r / side);
+	}
+}
+
+// What one rig chunk job needs : the driven rig's pose and this frame's view-projection
+struct RigFrame {
+	JointState Joints;
+	glm::mat4 VP;
+	bool Trace;			// followers keep the joints their IK solve left
+};
+
+// Followers take the driven rig's joints plus their own offset, then the chunk's matrices and
+// instance constants are computed while its rigs are still in cache
+void updateRigChunk(RigWorld &world, int first, int last, void *data)
+{
+	const RigFrame &frame = *(const RigFrame*)data;
+	const JointState &joints = frame.Joints;
+	const int lead = rigIndex(world, gRig);
+	for (int r = first; r < last; r++) {
+		if (r == lead || frame.Trace)
+			continue;
+		const float phase = float(r % 13) / 13.0f;
+		world.Rigs.BaseXPosition[r] = joints.BaseXPosition;
+		world.Rigs.BaseZPosition[r] = joints.BaseZPosition;
+		world.Rigs.TopYRotation[r] = joints.TopYRotation + phase * float(2 * PI);
+		world.Rigs.Arm1ZRotation[r] = joints.Arm1ZRotation + phase * 0.5f;
+		world.Rigs.Arm2ZRotation[r] = joints.Arm2ZRotation - phase * 0.5f;
+		world.Rigs.PenXRotation[r] = joints.PenXRotation;
+		world.Rigs.PenZRotation[r] = joints.PenZRotation;
+		world.Rigs.PenYRotation[r] = joints.PenYRotation + phase;
+	}
+	updateRigRange(world, first, last);
+	writeRigInstances(first, last, frame.VP);
+}
+
+// Instances of rigs [first, last) for every part; each job writes only its own rigs
+void writeRigInstances(int first, int last, const glm::mat4 &VP)
+{
+	for (int i = 0; i < NumRigParts; i++) {
+		const unsigned int ObjectIndex = RigParts[i].ObjectIndex;
+		PoolInstance* instances = &gPoolInstances[size_t(i) * gRigCount];
+		const glm::vec4 color = ObjectSelected[ObjectIndex] ? SelectedColor[ObjectIndex] : ObjectColor[ObjectIndex];
+		for (int r = first; r < last; r++) {
+			// A single rig is drawn straight from the scene graph
+			const glm::mat4 &M = (gRigCount == 1) ? gScene.World[RigParts[i].Node] : gWorld.Rigs.World[i][r];
+			computeObjectConstants(M, gViewMatrix, VP, instances[r].MVP, instances[r].MV, instances[r].NormalMatrix);
+			instances[r].Color = color;
+			instances[r].PickingColor = ObjectIndex / 255.0f;
+		}
+	}
+}
+
+void updatePoolInstances(void)
+{
+	// Part-major so each part's instances are contiguous for its command
+	RigFrame frame;
+	frame.VP = gProjectionMatrix * gViewMatrix;
+	gPoolInstances.resize(size_t(NumRigParts) * gRigCount);
+	if (gRigCount > 1) {
+		resizeStressRigs(gRigCount - 1);
+		frame.Joints = captureJoints();
+		frame.Trace = keyMode == 7;
+		if (frame.Trace)
+			traceStressRigs();
+		// Returns once every chunk is done : nothing is submitted from a half-written instance buffer
+		parallelForRigs(gWorld, gJobs, updateRigChunk, &frame);
+	}
+	else
+		writeRigInstances(0, 1, frame.VP);
+
+	gPoolCommandCount = 0;
+	for (int i = 0; i < NumRigParts; i++) {
+		// Parts still loading get no command, their instances are simply not referenced
+		const unsigned int ObjectIndex = RigParts[i].ObjectIndex;
+		if (PoolMeshIndex[ObjectIndex] >= 0)
+			gPoolCommands[gPoolCommandCount++] = poolCommand(gMeshPool, PoolMeshIndex[ObjectIndex], gRigCount, i * gRigCount);
+	}
+
+	// Orphaned and refilled, the driver hands out fresh storage instead of waiting on last frame's draws
+	uploadPoolInstances(gMeshPool, &gPoolInstances[0], (int)gPoolInstances.size());
+}
+
 void cleanup(void)
 {
 	// Cleanup VBO and shader
@@ -743,6 +1479,13 @@ void cleanup(void)
 		glDeleteBuffers(1, &IndexBufferId[i]);
 		glDeleteVertexArrays(1, &VertexArrayId[i]);
 	}
+	stopAssetLoader(gAssetLoader);
+	stopJobSystem(gJobs);
+	stopInputRecording(gInput);
+	destroyMeshPool(gMeshPool);
+	destroyUniformRing(gUniforms);
+	destroyAsyncPicker(gAsyncPicker);
+	destroyProfilerQueries(gProfiler);
 	glDeleteProgram(programID);
 	glDeleteProgram(pickingProgramID);
 
@@ -751,17 +1494,57 @@ void cleanup(void)
 }
 
 
+// Input is only queued here; the main loop drains the queue and applies it between frames
 static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	gRedraw = true;
+	if (action == GLFW_PRESS || action == GLFW_RELEASE)
+		pushKeyCommand(gInput, key, action == GLFW_PRESS);
+}
+
+static void mouseCallback(GLFWwindow* window, int button, int action, int mods)
+{
+	gRedraw = true;
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+		double xpos, ypos;
+		glfwGetCursorPos(window, &xpos, &ypos);
+		pushPointerCommand(gInput, PickCommand, xpos, ypos);
+	}
+}
+
+static void cursorCallback(GLFWwindow* window, double xpos, double ypos)
+{
+	// The hover text in the GUI follows the cursor
+	gRedraw = true;
+	pushPointerCommand(gInput, HoverCommand, xpos, ypos);
+}
+
+void applyInputCommand(const InputCommand &command)
+{
+	switch (command.Type) {
+		case KeyCommand:
+			applyKeyCommand(command.Key, command.Pressed != 0);
+			break;
+		case PickCommand:
+			applyPickCommand(command.X, command.Y);
+			break;
+		case HoverCommand:
+			applyHoverCommand(command.X, command.Y);
+			break;
+	}
+}
+
+void applyKeyCommand(int key, bool pressed)
 {
 	// Keypress Actions
-	if (action == GLFW_PRESS) {
+	if (pressed) {
 		switch (key)
 		{
 		case GLFW_KEY_1:
 			deselectObjectIndicies();
 			if (keyMode != 1) {
 				keyMode = 1;
-				Arm1Index = 10;
+				ObjectSelected[Arm1Index] = true;
 				printf("Arm1 is selected\n");
 			}
 			else {
@@ -773,7 +1556,7 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 			deselectObjectIndicies();
 			if (keyMode != 2) {
 				keyMode = 2;
-				Arm2Index = 11;
+				ObjectSelected[Arm2Index] = true;
 				printf("Arm2 is selected\n");
 			}
 			else {
@@ -796,7 +1579,7 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 			deselectObjectIndicies();
 			if (keyMode != 4) {
 				keyMode = 4;
-				PenIndex = 14;
+				ObjectSelected[PenIndex] = true;
 				printf("Pen is selected\n");
 			}
 			else {
@@ -808,7 +1591,7 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 			deselectObjectIndicies();
 			if (keyMode != 5) {
 				keyMode = 5;
-				BaseIndex = 9;
+				ObjectSelected[BaseIndex] = true;
 				printf("Base is selected\n");
 			}
 			else {
@@ -820,7 +1603,7 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 			deselectObjectIndicies();
 			if (keyMode != 6) {
 				keyMode = 6;
-				TopIndex = 15;
+				ObjectSelected[TopIndex] = true;
 				printf("Top is selected\n");
 			}
 			else {
@@ -828,6 +1611,18 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 				printf("Top is deselected\n");
 			}
 			break;
+		case GLFW_KEY_I:
+			deselectObjectIndicies();
+			if (keyMode != 7) {
+				keyMode = 7;
+				ObjectSelected[PenIndex] = true;
+				printf("Pen is tracing\n");
+			}
+			else {
+				keyMode = 0;
+				printf("Pen stopped tracing\n");
+			}
+			break;
 		case GLFW_KEY_LEFT:
 			printf("Left arrow key pressed\n");
 			rotationDirection = 1;
@@ -856,10 +1651,8 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 			break;
 		}
 	}
-
 	// Release Actions
-	if (action == GLFW_RELEASE) {
-
+	else {
 		switch (key) {
 			case GLFW_KEY_LEFT_SHIFT:
 			case GLFW_KEY_RIGHT_SHIFT:
@@ -869,18 +1662,46 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 				rotationDirection = 0;
 				break;
 		}
-		
+	}
+}
 
+// Picks run between frames, on the instances and uniforms of the last frame drawn
+void applyPickCommand(double xpos, double ypos)
+{
+	ScopedCpuTimer timer(gProfiler, PickTimer);
+	if (gRayPicking) {
+		RayHit hit;
+		selectPickedObject(pickObjectRay(xpos, ypos, hit));
 	}
+	// The GUI can turn async picking back on after the picker failed to build its framebuffer
+	else if (gAsyncPicking && gAsyncPicker.Framebuffer != 0)
+		pickObjectAsync(xpos, ypos);
+	else
+		pickObject(xpos, ypos);
 }
 
-static void mouseCallback(GLFWwindow* window, int button, int action, int mods)
+void applyHoverCommand(double xpos, double ypos)
 {
-	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
-		pickObject();
+	// Hover picking only touches the CPU copies of the meshes
+	RayHit hit;
+	const int hovered = pickObjectRay(xpos, ypos, hit);
+	if (hovered == 255) {
+		gHoverMessage = "background";
+	}
+	else {
+		std::ostringstream oss;
+		oss.precision(2);
+		oss << ObjectNames[hovered] << " (triangle " << hit.Triangle << ", u " << hit.U << " v " << hit.V << ")";
+		gHoverMessage = oss.str();
 	}
 }
 
+// Exposed or resized : the window contents are gone
+static void refreshCallback(GLFWwindow* window)
+{
+	gRedraw = true;
+}
+
 glm::vec3 setLookat() {
 
 	// Rotation matrix about the X axis, up and down
@@ -930,14 +1751,20 @@ void rotateCamera() {
 
 }
 
+// Steps a joint of the driven rig, within that rig's limits
+void moveJoint(RigJoint joint, float delta)
+{
+	moveRigJoint(gWorld, rigIndex(gWorld, gRig), joint, delta);
+}
+
 void rotateArm1Position() {
 
 	switch (rotationDirection) {
 	case 3:				// Up
-		Arm1ZRotation < (2 * PI / 3) ? Arm1ZRotation += 0.05 : false;
+		moveJoint(RigArm1Z, 0.05f);
 		break;
 	case 4:				// Down
-		Arm1ZRotation > ( (-1) * PI / 4) ? Arm1ZRotation -= 0.05 : false;
+		moveJoint(RigArm1Z, -0.05f);
 		break;
 	default:			// Not started
 		break;
@@ -948,10 +1775,10 @@ void rotateArm2Position() {
 
 	switch (rotationDirection) {
 	case 3:				// Up
-		Arm2ZRotation < ( PI ) ? Arm2ZRotation += 0.05 : false;
+		moveJoint(RigArm2Z, 0.05f);
 		break;
 	case 4:				// Down
-		Arm2ZRotation > ( (-1) * PI / 3 ) ? Arm2ZRotation -= 0.05 : false;
+		moveJoint(RigArm2Z, -0.05f);
 		break;
 	default:			// Not started
 		break;
@@ -962,10 +1789,10 @@ void rotateTopPosition() {
 
 	switch (rotationDirection) {
 	case 1:				// Left
-		TopYRotation += 0.05;
+		moveJoint(RigTopY, 0.05f);
 		break;
 	case 2:				// Right
-		TopYRotation -= 0.05;
+		moveJoint(RigTopY, -0.05f);
 		break;
 	default:			// Not started
 		break;
@@ -976,16 +1803,16 @@ void translateBasePosition() {
 
 	switch (rotationDirection) {
 	case 1:				// Left
-		BaseZPosition < (5) ? BaseZPosition += 0.1 : false;
+		moveJoint(RigBaseZ, 0.1f);
 		break;
 	case 2:				// Right
-		BaseZPosition > ((-1) * 5) ? BaseZPosition -= 0.1 : false;
+		moveJoint(RigBaseZ, -0.1f);
 		break;
 	case 3:				// Up
-		BaseXPosition > ((-1) * 5) ? BaseXPosition -= 0.1 : false;
+		moveJoint(RigBaseX, -0.1f);
 		break;
 	case 4:				// Down
-		BaseXPosition < (5) ? BaseXPosition += 0.1 : false;
+		moveJoint(RigBaseX, 0.1f);
 		break;
 	default:			// Not started
 		break;
@@ -996,26 +1823,16 @@ void rotatePenPosition() {
 
 	switch (rotationDirection) {
 	case 1:				// Left
-		if (shiftPressed) {
-			PenYRotation < ( PI / 2) ? PenYRotation += 0.05 : false;
-		}
-		else {
-			PenXRotation < (PI / 3) ? PenXRotation += 0.05 : false;
-		}
+		moveJoint(shiftPressed ? RigPenY : RigPenX, 0.05f);
 		break;
 	case 2:				// Right
-		if (shiftPressed) {
-			PenYRotation > ((-1) * PI / 2) ? PenYRotation -= 0.05 : false;
-		}
-		else {
-			PenXRotation > ((-1) * PI / 3) ? PenXRotation -= 0.05 : false;
-		}
+		moveJoint(shiftPressed ? RigPenY : RigPenX, -0.05f);
 		break;
 	case 3:				// Up
-		PenZRotation < ( PI / 4) ? PenZRotation += 0.05 : false;
+		moveJoint(RigPenZ, 0.05f);
 		break;
 	case 4:				// Down
-		PenZRotation > ((-1) * PI / 4) ? PenZRotation -= 0.05 : false;
+		moveJoint(RigPenZ, -0.05f);
 		break;
 	default:			// Not started
 		break;
@@ -1023,68 +1840,451 @@ void rotatePenPosition() {
 
 }
 
+// Point of the traced circle at angle, around where a rig's base stands
+glm::vec3 traceTarget(int rig, float angle)
+{
+	const float x = gWorld.Rigs.RootX[rig] + gWorld.Rigs.BaseXPosition[rig] + TraceDistance;
+	const float z = gWorld.Rigs.RootZ[rig] + gWorld.Rigs.BaseZPosition[rig];
+	return glm::vec3(x + TraceRadius * cos(angle), TraceHeight, z + TraceRadius * sin(angle));
+}
+
+// Moves the driven rig's pen tip one step further along its circle. A point out of reach is
+// skipped : the pen stays where it was and the step counts as missed
+void traceCircle(void)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	gTraceAngle += TraceSpeed;
+	if (gTraceAngle > float(2 * PI))
+		gTraceAngle -= float(2 * PI);
+
+	const int rig = rigIndex(gWorld, gRig);
+	float joints[NumRigJoints];
+	for (int j = 0; j < NumRigJoints; j++)
+		joints[j] = rigJoint(gWorld, rig, RigJoint(j));
+
+	const Clock::time_point start = Clock::now();
+	const IkResult result = solveRigIk(gWorld, rig, traceTarget(rig, gTraceAngle), DefaultIkSettings);
+	gIkSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+	gIkTargets++;
+	gIkIterations += result.Iterations;
+
+	if (result.Error > DefaultIkSettings.Tolerance) {
+		for (int j = 0; j < NumRigJoints; j++)
+			setRigJoint(gWorld, rig, RigJoint(j), joints[j]);
+		gIkMissed++;
+	}
+}
+
+// Followers trace the same circle around their own spot, each a little ahead; the solve time goes
+// to the chunk's own slot of data
+void traceRigChunk(RigWorld &world, int first, int last, void *data)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const int lead = rigIndex(world, gRig);
+	for (int r = first; r < last; r++) {
+		if (r == lead)
+			continue;
+		const float phase = float(r % 13) / 13.0f;
+		setRigTarget(gTargets, r, traceTarget(r, gTraceAngle + phase * float(2 * PI)));
+	}
+	const Clock::time_point start = Clock::now();
+	solveRigIkRange(world, gTargets, first, last, DefaultIkSettings);
+	((double*)data)[first / RigWorldChunk] = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Followers out of reach stay at the closest pose their solve found
+void traceStressRigs(void)
+{
+	// The driven rig is solved on its updates, not here
+	const int count = rigCount(gWorld);
+	gTargets.resize(count);
+	gTargets.Enabled[rigIndex(gWorld, gRig)] = 0.0f;
+
+	gTraceChunkSeconds.assign((count + RigWorldChunk - 1) / RigWorldChunk, 0.0);
+	parallelForRigs(gWorld, gJobs, traceRigChunk, &gTraceChunkSeconds[0]);
+	for (size_t c = 0; c < gTraceChunkSeconds.size(); c++)
+		gIkSeconds += gTraceChunkSeconds[c];
+
+	for (int r = 0; r < count; r++) {
+		if (gTargets.Enabled[r] != 0.0f) {
+			gIkTargets++;
+			gIkIterations += gTargets.Iterations[r];
+			if (gTargets.Error[r] > DefaultIkSettings.Tolerance)
+				gIkMissed++;
+		}
+	}
+}
+
+
+void updateJoints(void)
+{
+	switch (keyMode) {
+		case 0:
+			break;
+		case 1:		// Arm1
+			rotateArm1Position();
+			break;
+		case 2:		// Arm2
+			rotateArm2Position();
+			break;
+		case 3:		// Camera
+			rotateCamera();
+			break;
+		case 4:		// Pen
+			rotatePenPosition();
+			break;
+		case 5:		// Base
+			translateBasePosition();
+			break;
+		case 6:		// Top
+			rotateTopPosition();
+			break;
+		case 7:		// Trace
+			traceCircle();
+			break;
+	}
+}
+
+JointState captureJoints(void)
+{
+	const int rig = rigIndex(gWorld, gRig);
+	JointState joints;
+	float* values = &joints.BaseXPosition;
+	for (int j = 0; j < NumRigJoints; j++)
+		values[j] = rigJoint(gWorld, rig, RigJoint(j));
+	joints.ThetaX = thetaX;
+	joints.ThetaY = thetaY;
+	return joints;
+}
+
+void applyJoints(const JointState &joints)
+{
+	const int rig = rigIndex(gWorld, gRig);
+	const float* values = &joints.BaseXPosition;
+	for (int j = 0; j < NumRigJoints; j++)
+		setRigJoint(gWorld, rig, RigJoint(j), values[j]);
+	thetaX = joints.ThetaX;
+	thetaY = joints.ThetaY;
+}
 
-int main(void)
+JointState interpolateJoints(const JointState &from, const JointState &to, float alpha)
 {
+	const float* a = &from.BaseXPosition;
+	const float* b = &to.BaseXPosition;
+	JointState joints;
+	float* out = &joints.BaseXPosition;
+	for (size_t i = 0; i < sizeof(JointState) / sizeof(float); i++)
+		out[i] = a[i] + (b[i] - a[i]) * alpha;
+	return joints;
+}
+
+// Anything that can make the next frame differ from the last one drawn
+bool needsRedraw(void)
+{
+	if (gRedraw || animation)
+		return true;
+	// A held key moves a joint or the camera on every update
+	if (keyMode != 0 && rotationDirection != 0)
+		return true;
+	// So does tracing
+	if (keyMode == 7)
+		return true;
+	// Readbacks and loaded parts are only collected by rendering frames
+	if (gAsyncPicking && asyncPicksPending(gAsyncPicker))
+		return true;
+	if (assetLoadsPending(gAssetLoader))
+		return true;
+	// A replay keeps feeding input whether or not anything moves
+	if (inputReplayActive(gInput))
+		return true;
+	// The last frame may have been drawn part way into the final update
+	const JointState joints = captureJoints();
+	return memcmp(&joints, &gDrawnJoints, sizeof(JointState)) != 0;
+}
+
+// One leg of the scripted benchmark : hold a key on a selected part for a number of frames
+struct BenchStep {
+	int Frames;
+	int KeyMode;
+	int Direction;	// rotationDirection
+	int Shift;
+};
+
+const BenchStep BenchScript[] = {
+	{ 60, 3, 1, 0 },	// camera left
+	{ 20, 3, 3, 0 },	// camera up
+	{ 50, 1, 3, 0 },	// Arm1 up
+	{ 40, 2, 4, 0 },	// Arm2 down
+	{ 30, 4, 1, 0 },	// Pen tilt
+	{ 30, 4, 2, 1 },	// Pen spin
+	{ 50, 5, 1, 0 },	// Base along Z
+	{ 50, 6, 2, 0 },	// Top
+	{ 50, 5, 2, 0 },	// Base back
+	{ 40, 1, 4, 0 },	// Arm1 down
+	{ 120, 7, 0, 0 },	// Pen traces its circle
+	{ 20, 3, 4, 0 },	// camera down
+	{ 60, 3, 2, 0 }		// camera right
+};
+const int NumBenchSteps = sizeof(BenchScript) / sizeof(BenchScript[0]);
+const int BenchPickInterval = 4;		// frames between scripted picks
+const int BenchImageInterval = 60;		// frames between reference images
+
+// Replays BenchScript for frames frames into an offscreen framebuffer, no window or display needed.
+// Every frame runs the joint update and the scene pass and waits for the GPU; every
+// BenchPickInterval frames a GPU pick and a BVH ray pick are made at a point sweeping the screen.
+// The sequence only depends on the frame number, so runs are comparable.
+// With --replay, the logged input drives the rig instead : one update per frame, so each
+// command lands on the very tick it was recorded at.
+int runHeadlessBenchmark(int frames, const char* imageDir, const char* profileOut)
+{
+	HeadlessContext headless;
+	if (!createHeadlessContext(headless, window_width, window_height))
+		return -1;
+	startJobSystem(gJobs, gJobThreads);
+
+	// The async picker hands its framebuffer back to 0, which doesn't exist here
+	gAsyncPicking = false;
+	initProfiler();
+	initOpenGL();
+	glBindFramebuffer(GL_FRAMEBUFFER, headless.Framebuffer);
+
+	// Every frame of the script draws the whole rig
+	pollAssetLoads(true);
+
+	printf("Headless benchmark : %d frames at %dx%d on %s\n", frames, window_width, window_height, headlessRenderer());
+	const bool replay = inputReplayActive(gInput);
+	if (replay)
+		printf("Replaying %u input commands over %u ticks\n", (unsigned int)gInput.Replay.size(), inputReplayTicks(gInput));
+
+	int step = 0, stepFrame = 0, picks = 0, rayHits = 0;
+	for (int frame = 0; frame < frames; frame++) {
+		beginCpuTimer(gProfiler, FrameTimer);
+
+		if (replay) {
+			const std::vector<InputCommand> &commands = drainInputQueue(gInput, (unsigned int)frame);
+			for (size_t i = 0; i < commands.size(); i++)
+				applyInputCommand(commands[i]);
+		}
+		else {
+			const BenchStep &current = BenchScript[step];
+			keyMode = current.KeyMode;
+			rotationDirection = current.Direction;
+			shiftPressed = current.Shift;
+			if (++stepFrame == current.Frames) {
+				step = (step + 1) % NumBenchSteps;
+				stepFrame = 0;
+			}
+		}
+
+		// Exactly one fixed update per frame : the script counts ticks, not seconds
+		beginCpuTimer(gProfiler, UpdateTimer);
+		updateJoints();
+		endCpuTimer(gProfiler, UpdateTimer);
+
+		beginCpuTimer(gProfiler, RenderTimer);
+		collectGpuTimers(gProfiler);
+		drawScene();
+		glFinish();
+		endCpuTimer(gProfiler, RenderTimer);
+
+		if (imageDir != NULL && frame % BenchImageInterval == 0) {
+			char path[512];
+			snprintf(path, sizeof(path), "%s/frame_%05d.ppm", imageDir, frame);
+			writeFramebufferPPM(path, window_width, window_height);
+		}
+
+		if (!replay && frame % BenchPickInterval == 0) {
+			// Diagonal sweep through the middle of the screen, where the rig stands
+			const double t = (frame / BenchPickInterval % 64) / 63.0;
+			const double xpos = window_width * (0.25 + 0.5 * t);
+			const double ypos = window_height * (0.75 - 0.5 * t);
+
+			ScopedCpuTimer timer(gProfiler, PickTimer);
+			RayHit hit;
+			if (pickObjectAt(xpos, ypos) != 255)
+				picks++;
+			if (pickObjectRay(xpos, ypos, hit) != 255)
+				rayHits++;
+		}
+
+		endFrameStats();
+		endCpuTimer(gProfiler, FrameTimer);
+	}
+	collectGpuTimers(gProfiler);
+
+	if (!replay)
+		printf("%d of %d GPU picks and %d ray picks hit the rig\n", picks, (frames + BenchPickInterval - 1) / BenchPickInterval, rayHits);
+	printProfileStats(gProfiler);
+	if (gDrawStats.Validate)
+		printf("Draw validation : %u errors\n", gDrawStats.TotalErrors);
+	if (profileOut != NULL) {
+		const std::string base = profileOut;
+		writeProfileCSV(gProfiler, (base + ".csv").c_str());
+		writeProfileJSON(gProfiler, (base + ".json").c_str());
+	}
+
+	// glfwTerminate() in cleanup() is fine without glfwInit()
+	cleanup();
+	destroyHeadlessContext(headless);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	// Command line benchmarks run without opening a window
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--bench-transforms") == 0) {
+			benchmarkRigBatch();
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench-ik") == 0) {
+			benchmarkRigIk();
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench-rigworld") == 0) {
+			benchmarkRigWorld(i + 1 < argc ? atoi(argv[i + 1]) : 0);
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench-meshcache") == 0)
+			return benchmarkMeshCache(argc - i - 1, argv + i + 1) ? 0 : 1;
+		if (strcmp(argv[i], "--bench-indexer") == 0)
+			return benchmarkIndexer() ? 0 : 1;
+		if (strcmp(argv[i], "--bench-loadalloc") == 0)
+			return benchmarkLoadAllocations(argc - i - 1, argv + i + 1) ? 0 : 1;
+		if (strcmp(argv[i], "--legacy-vertices") == 0)
+			gMeshLayout = LegacyLayout;
+		if (strcmp(argv[i], "--rigs") == 0 && i + 1 < argc)
+			gRigCount = glm::max(1, atoi(argv[++i]));
+		if (strcmp(argv[i], "--validate-draws") == 0)
+			initDrawValidator(gDrawStats, true);
+		if (strcmp(argv[i], "--update-rate") == 0 && i + 1 < argc)
+			gUpdateRate = glm::max(1.0, atof(argv[++i]));
+		if (strcmp(argv[i], "--max-fps") == 0 && i + 1 < argc)
+			gMaxFps = glm::max(0.0, atof(argv[++i]));
+		if (strcmp(argv[i], "--no-vsync") == 0)
+			gVSync = false;
+		if (strcmp(argv[i], "--on-demand") == 0)
+			gRenderOnDemand = true;
+		if (strcmp(argv[i], "--load-threads") == 0 && i + 1 < argc)
+			gLoaderThreads = glm::max(0, atoi(argv[++i]));
+		if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			gRecordPath = argv[++i];
+		if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			gReplayPath = argv[++i];
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			gJobThreads = glm::max(0, atoi(argv[++i]));
+	}
+
+	initInputQueue(gInput);
+	if (gReplayPath != NULL && !loadInputReplay(gInput, gReplayPath))
+		return 1;
+
+	// Offscreen replay of the benchmark script, for machines without a display
+	int headlessFrames = 0;
+	bool framesGiven = false;
+	const char* imageDir = NULL;
+	const char* profileOut = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0) {
+			headlessFrames = 600;
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+				headlessFrames = atoi(argv[++i]);
+				framesGiven = true;
+			}
+		}
+		else if (strcmp(argv[i], "--reference-images") == 0 && i + 1 < argc)
+			imageDir = argv[++i];
+		else if (strcmp(argv[i], "--profile-out") == 0 && i + 1 < argc)
+			profileOut = argv[++i];
+	}
+	// A replay runs to its last command unless told otherwise
+	if (headlessFrames > 0 && !framesGiven && gReplayPath != NULL)
+		headlessFrames = glm::max(1, int(inputReplayTicks(gInput)));
+	if (headlessFrames > 0)
+		return runHeadlessBenchmark(headlessFrames, imageDir, profileOut) == 0 ? 0 : 1;
+
+	if (gRecordPath != NULL && !startInputRecording(gInput, gRecordPath))
+		return 1;
+
 	// initialize window
 	int errorCode = initWindow();
 	if (errorCode != 0)
 		return errorCode;
+	startJobSystem(gJobs, gJobThreads);
 
 	// initialize OpenGL pipeline
 	initOpenGL();
 
+	// The swap waits for the display instead of the loop spinning
+	glfwSwapInterval(gVSync ? 1 : 0);
+	initFrameScheduler(gScheduler, gUpdateRate, gMaxFps, gVSync);
+	gPreviousJoints = captureJoints();
+
 	// For speed computation
-	double lastTime = glfwGetTime();
 	int nbFrames = 0;
 	do {
-		//// Measure speed
-		//double currentTime = glfwGetTime();
-		//nbFrames++;
-		//if (currentTime - lastTime >= 1.0){ // If last prinf() was more than 1sec ago
-		//	// printf and reset
-		//	printf("%f ms/frame\n", 1000.0 / double(nbFrames));
-		//	nbFrames = 0;
-		//	lastTime += 1.0;
-		//}
-		
-		if (animation){
-			phi += 0.01;
-			if (phi > 360)
-				phi -= 360;
+		// Nothing to change on screen : block until an event arrives, without burning a core
+		if (gRenderOnDemand && !needsRedraw()) {
+			glfwWaitEvents();
+			resetFrameScheduler(gScheduler);
+			gPreviousJoints = captureJoints();
+			continue;
 		}
-
-		switch (keyMode) {
-			case 0:
-				break;
-			case 1:		// Arm1
-				rotateArm1Position();
-				break;
-			case 2:		// Arm2
-				rotateArm2Position();
-				break;
-			case 3:		// Camera
-				rotateCamera();
-				break;
-			case 4:		// Pen
-				rotatePenPosition();
-				break;
-			case 5:		// Base
-				translateBasePosition();
-				break;
-			case 6:		// Top
-				rotateTopPosition();
-				break;
+		gRedraw = false;
+
+		beginCpuTimer(gProfiler, FrameTimer);
+
+		// Input since the last frame (or the replay up to this tick) goes in before the updates
+		const std::vector<InputCommand> &commands = drainInputQueue(gInput, (unsigned int)gScheduler.Ticks);
+		for (size_t i = 0; i < commands.size(); i++)
+			applyInputCommand(commands[i]);
+
+		// Fixed updates for the time since the last frame, none at all on a fast frame
+		const int steps = advanceFrameScheduler(gScheduler);
+		beginCpuTimer(gProfiler, UpdateTimer);
+		for (int i = 0; i < steps; i++) {
+			if (animation){
+				phi += 0.01;
+				if (phi > 360)
+					phi -= 360;
+			}
+			gPreviousJoints = captureJoints();
+			updateJoints();
 		}
+		endCpuTimer(gProfiler, UpdateTimer);
 
 		// DRAWING POINTS
+		// Drawn Alpha of the way from the previous update to the last one, then the
+		// simulation state is put back; picks see the drawn pose
+		const JointState current = captureJoints();
+		gDrawnJoints = interpolateJoints(gPreviousJoints, current, float(gScheduler.Alpha));
+		applyJoints(gDrawnJoints);
 		renderScene();
+		applyJoints(current);
+		endFrameStats();
+
+		// The HUD refreshes twice a second, no need to sort the windows every frame
+		endCpuTimer(gProfiler, FrameTimer);
+		if (++nbFrames % 16 == 0)
+			updateProfilerSummaries(gProfiler);
+
+		paceFrame(gScheduler);
 
 
 	} // Check if the ESC key was pressed or the window was closed
 	while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
 	glfwWindowShouldClose(window) == 0);
 
+	if (profileOut != NULL) {
+		const std::string base = profileOut;
+		writeProfileCSV(gProfiler, (base + ".csv").c_str());
+		writeProfileJSON(gProfiler, (base + ".json").c_str());
+	}
+	if (gRecordPath != NULL)
+		printf("%u input commands recorded to %s\n", gInput.Recorded, gRecordPath);
+	printf("%u input commands, %u picks and hovers coalesced\n", gInput.Pushed, gInput.Coalesced);
 	cleanup();
 
 	return 0;
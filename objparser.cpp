@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "objparser.hpp"
+
+static inline bool isBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool isLineEnd(char c)
+{
+	return c == '\n' || c == '\0';
+}
+
+static const char *skipBlanks(const char *p)
+{
+	while (isBlank(*p))
+		p++;
+	return p;
+}
+
+static const char *nextLine(const char *p)
+{
+	while (!isLineEnd(*p))
+		p++;
+	return *p == '\n' ? p + 1 : p;
+}
+
+// Line keyword : 'v' for positions, 'n' for normals, 'f' for faces, 0 for anything else
+static char lineType(const char *line, const char *&rest)
+{
+	const char *p = skipBlanks(line);
+	if (p[0] == 'v' && isBlank(p[1])) {
+		rest = p + 1;
+		return 'v';
+	}
+	if (p[0] == 'v' && p[1] == 'n' && isBlank(p[2])) {
+		rest = p + 2;
+		return 'n';
+	}
+	if (p[0] == 'f' && isBlank(p[1])) {
+		rest = p + 1;
+		return 'f';
+	}
+	return 0;
+}
+
+static glm::vec3 parseVec3(const char *p)
+{
+	char *end;
+	glm::vec3 v;
+	v.x = strtof(p, &end);
+	v.y = strtof(end, &end);
+	v.z = strtof(end, &end);
+	return v;
+}
+
+// 1-based index, or negative and relative to the count so far; -1 if out of range
+static long resolveIndex(long index, size_t seen, size_t total)
+{
+	if (index > 0 && size_t(index) <= total)
+		return index - 1;
+	if (index < 0 && size_t(-index) <= seen)
+		return long(seen) + index;
+	return -1;
+}
+
+// One face corner, "v", "v/t", "v//n" or "v/t/n"; normal is 0 when absent
+static const char *parseCorner(const char *p, long &position, long &normal)
+{
+	char *end;
+	position = strtol(p, &end, 10);
+	normal = 0;
+	if (*end == '/') {
+		end++;
+		if (*end != '/')
+			strtol(end, &end, 10);
+		if (*end == '/')
+			normal = strtol(end + 1, &end, 10);
+	}
+	while (!isBlank(*end) && !isLineEnd(*end))
+		end++;
+	return end;
+}
+
+bool parseOBJ(const char *path, ScratchArena &arena, ObjSoup &soup)
+{
+	soup.Positions = soup.Normals = NULL;
+	soup.Count = 0;
+
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "ERROR: Can't open %s\n", path);
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	const long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size < 0) {
+		fclose(file);
+		return false;
+	}
+	char *text = scratchArray<char>(arena, size_t(size) + 1);
+	text[fread(text, 1, size_t(size), file)] = '\0';
+	fclose(file);
+
+	// Count first, so every array is allocated once at its final size
+	size_t positionCount = 0, normalCount = 0, cornerCount = 0;
+	for (const char *line = text; *line != '\0'; line = nextLine(line)) {
+		const char *p;
+		const char type = lineType(line, p);
+		if (type == 'v')
+			positionCount++;
+		else if (type == 'n')
+			normalCount++;
+		else if (type == 'f') {
+			int corners = 0;
+			for (p = skipBlanks(p); !isLineEnd(*p); p = skipBlanks(p)) {
+				while (!isBlank(*p) && !isLineEnd(*p))
+					p++;
+				corners++;
+			}
+			if (corners >= 3)
+				cornerCount += 3 * (corners - 2);
+		}
+	}
+
+	glm::vec3 *positions = scratchArray<glm::vec3>(arena, positionCount);
+	glm::vec3 *normals = scratchArray<glm::vec3>(arena, normalCount);
+	soup.Positions = scratchArray<glm::vec3>(arena, cornerCount);
+	soup.Normals = scratchArray<glm::vec3>(arena, cornerCount);
+
+	size_t positionsSeen = 0, normalsSeen = 0;
+	for (const char *line = text; *line != '\0'; line = nextLine(line)) {
+		const char *p;
+		const char type = lineType(line, p);
+		if (type == 'v')
+			positions[positionsSeen++] = parseVec3(p);
+		else if (type == 'n')
+			normals[normalsSeen++] = parseVec3(p);
+	}
+
+	// Faces may refer to vertices further down the file, so they go once every vertex is in
+	positionsSeen = normalsSeen = 0;
+	for (const char *line = text; *line != '\0'; line = nextLine(line)) {
+		const char *p;
+		const char type = lineType(line, p);
+		if (type == 'v')
+			positionsSeen++;
+		else if (type == 'n')
+			normalsSeen++;
+		if (type != 'f')
+			continue;
+
+		long firstPosition = 0, firstNormal = 0, lastPosition = 0, lastNormal = 0;
+		int corners = 0;
+		for (p = skipBlanks(p); !isLineEnd(*p); p = skipBlanks(p)) {
+			long position, normal;
+			p = parseCorner(p, position, normal);
+			position = resolveIndex(position, positionsSeen, positionCount);
+			normal = normal != 0 ? resolveIndex(normal, normalsSeen, normalCount) : -2;
+			if (position < 0 || normal == -1) {
+				fprintf(stderr, "ERROR: %s has a face with a vertex out of range\n", path);
+				return false;
+			}
+
+			// Fan : every corner after the second closes a triangle with the first and the previous one
+			if (corners >= 2) {
+				const long trianglePositions[3] = { firstPosition, lastPosition, position };
+				const long triangleNormals[3] = { firstNormal, lastNormal, normal };
+				for (int k = 0; k < 3; k++) {
+					soup.Positions[soup.Count] = positions[trianglePositions[k]];
+					soup.Normals[soup.Count] = triangleNormals[k] >= 0 ? normals[triangleNormals[k]] : glm::vec3(0.0f);
+					soup.Count++;
+				}
+			}
+			if (corners == 0) {
+				firstPosition = position;
+				firstNormal = normal;
+			}
+			lastPosition = position;
+			lastNormal = normal;
+			corners++;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,22 @@
+#ifndef OBJPARSER_HPP
+#define OBJPARSER_HPP
+
+#include <stddef.h>
+#include <glm/glm.hpp>
+
+#include "scratcharena.hpp"
+
+// .obj reader whose every buffer comes from a scratch arena : the file is read in one
+// piece, counted, and parsed into arrays of exactly the right size.
+// The result is the same unindexed triangle soup loadOBJ() builds, one position and
+// normal per face corner; faces with more than three corners are fanned into triangles.
+
+struct ObjSoup {
+	glm::vec3 *Positions;
+	glm::vec3 *Normals;
+	size_t Count;			// corners, 3 per triangle
+};
+
+bool parseOBJ(const char *path, ScratchArena &arena, ObjSoup &soup);
+
+#endif
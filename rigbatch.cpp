@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "rigbatch.hpp"
+#include "riglanes.hpp"
+
+// Same order as RigJoint
+static RigFloats RigBatch::* const JointArrays[NumRigJoints] = {
+	&RigBatch::BaseXPosition,
+	&RigBatch::BaseZPosition,
+	&RigBatch::TopYRotation,
+	&RigBatch::Arm1ZRotation,
+	&RigBatch::Arm2ZRotation,
+	&RigBatch::PenXRotation,
+	&RigBatch::PenZRotation,
+	&RigBatch::PenYRotation
+};
+
+void RigBatch::resize(int count)
+{
+	const int padded = (count + RigBatchPadding - 1) / RigBatchPadding * RigBatchPadding;
+
+	Count = count;
+	for (int j = 0; j < NumRigJoints; j++)
+		(this->*JointArrays[j]).resize(padded, 0.0f);
+	RootX.resize(padded, 0.0f);
+	RootZ.resize(padded, 0.0f);
+	for (int part = 0; part < NumBatchParts; part++)
+		World[part].resize(padded, glm::mat4(1.0));
+}
+
+RigFloats &RigBatch::joint(RigJoint joint)
+{
+	return this->*JointArrays[joint];
+}
+
+const RigFloats &RigBatch::joint(RigJoint joint) const
+{
+	return this->*JointArrays[joint];
+}
+
+
+//-- SCALAR REFERENCE --//
+
+void computeRigBatchScalar(RigBatch &batch)
+{
+	const glm::vec3 XAxis = glm::vec3(1.0f, 0.0f, 0.0f);
+	const glm::vec3 YAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+	const glm::vec3 ZAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+
+	for (int i = 0; i < batch.Count; i++) {
+		glm::mat4 M = glm::translate(glm::mat4(1.0), glm::vec3(batch.RootX[i] + batch.BaseXPosition[i], 0.5f, batch.RootZ[i] + batch.BaseZPosition[i]));
+		batch.World[BatchBase][i] = M;
+
+		M = glm::rotate(M, batch.TopYRotation[i], YAxis);
+		M = glm::translate(M, glm::vec3(0.0f, 0.75f, 0.0f));
+		batch.World[BatchTop][i] = M;
+
+		M = glm::rotate(M, float((-1) * PI / 4) + batch.Arm1ZRotation[i], ZAxis);
+		M = glm::translate(M, glm::vec3(0.0f, 0.75f, 0.0f));
+		batch.World[BatchArm1][i] = M;
+
+		M = glm::scale(M, glm::vec3(0.65f));
+		M = glm::translate(M, glm::vec3(0.0f, 2.05f, 0.0f));
+		batch.World[BatchJoint][i] = M;
+
+		M = glm::scale(M, glm::vec3(2.0f));
+		M = glm::rotate(M, float((-1) * PI / 2.5) + batch.Arm2ZRotation[i], ZAxis);
+		M = glm::translate(M, glm::vec3(0.0f, 0.5f, 0.0f));
+		batch.World[BatchArm2][i] = M;
+
+		M = glm::rotate(M, float(2 * PI / 4), ZAxis);
+		M = glm::translate(M, glm::vec3(0.6f, 0.0f, 0.0f));
+		M = glm::rotate(M, batch.PenXRotation[i], XAxis);
+		M = glm::rotate(M, batch.PenZRotation[i], ZAxis);
+		M = glm::translate(M, glm::vec3(0.0f, 0.2f, 0.0f));
+		M = glm::rotate(M, batch.PenYRotation[i], YAxis);
+		batch.World[BatchPen][i] = M;
+
+		M = glm::translate(M, glm::vec3(0.05f, 0.0f, 0.0f));
+		batch.World[BatchButton][i] = M;
+	}
+}
+
+
+//-- KERNEL --//
+
+static inline void storeAffine(const AffineLanes<LaneScalar> &A, glm::mat4 *out)
+{
+	for (int col = 0; col < 4; col++) {
+		out[0][col] = glm::vec4(A.M[col][0].v, A.M[col][1].v, A.M[col][2].v, col == 3 ? 1.0f : 0.0f);
+	}
+}
+
+#ifdef RIGBATCH_SSE
+// Transpose 4 lanes of x/y/z/w back into one column per rig
+static inline void storeColumnsSSE(__m128 x, __m128 y, __m128 z, __m128 w, glm::mat4 *out, int col)
+{
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	_mm_store_ps(&out[0][col][0], x);
+	_mm_store_ps(&out[1][col][0], y);
+	_mm_store_ps(&out[2][col][0], z);
+	_mm_store_ps(&out[3][col][0], w);
+}
+
+static inline void storeAffine(const AffineLanes<LaneSSE> &A, glm::mat4 *out)
+{
+	for (int col = 0; col < 4; col++) {
+		const __m128 w = _mm_set1_ps(col == 3 ? 1.0f : 0.0f);
+		storeColumnsSSE(A.M[col][0].v, A.M[col][1].v, A.M[col][2].v, w, out, col);
+	}
+}
+#endif
+
+#ifdef RIGBATCH_AVX
+static inline void storeAffine(const AffineLanes<LaneAVX> &A, glm::mat4 *out)
+{
+	for (int col = 0; col < 4; col++) {
+		const __m128 w = _mm_set1_ps(col == 3 ? 1.0f : 0.0f);
+		const __m256 x = A.M[col][0].v, y = A.M[col][1].v, z = A.M[col][2].v;
+		storeColumnsSSE(_mm256_castps256_ps128(x), _mm256_castps256_ps128(y), _mm256_castps256_ps128(z), w, out, col);
+		storeColumnsSSE(_mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1), w, out + 4, col);
+	}
+}
+#endif
+
+// Same chain as computeRigBatchScalar(), for V::Width rigs starting at first
+template <class V>
+static inline void rigKernel(RigBatch &batch, int first)
+{
+	V s, c;
+	AffineLanes<V> A;
+
+	// Base
+	for (int col = 0; col < 3; col++)
+		for (int r = 0; r < 3; r++)
+			A.M[col][r] = V(col == r ? 1.0f : 0.0f);
+	A.M[3][0] = V::load(&batch.RootX[first]) + V::load(&batch.BaseXPosition[first]);
+	A.M[3][1] = V(0.5f);
+	A.M[3][2] = V::load(&batch.RootZ[first]) + V::load(&batch.BaseZPosition[first]);
+	storeAffine(A, &batch.World[BatchBase][first]);
+
+	// Top
+	laneSinCos(V::load(&batch.TopYRotation[first]), s, c);
+	rotateY(A, c, s);
+	translateAxis(A, 1, V(0.75f));
+	storeAffine(A, &batch.World[BatchTop][first]);
+
+	// Arm1
+	laneSinCos(V::load(&batch.Arm1ZRotation[first]) + V(float((-1) * PI / 4)), s, c);
+	rotateZ(A, c, s);
+	translateAxis(A, 1, V(0.75f));
+	storeAffine(A, &batch.World[BatchArm1][first]);
+
+	// Joint
+	scaleUniform(A, V(0.65f));
+	translateAxis(A, 1, V(2.05f));
+	storeAffine(A, &batch.World[BatchJoint][first]);
+
+	// Arm2
+	scaleUniform(A, V(2.0f));
+	laneSinCos(V::load(&batch.Arm2ZRotation[first]) + V(float((-1) * PI / 2.5)), s, c);
+	rotateZ(A, c, s);
+	translateAxis(A, 1, V(0.5f));
+	storeAffine(A, &batch.World[BatchArm2][first]);
+
+	// Pen
+	quarterTurnZ(A);
+	translateAxis(A, 0, V(0.6f));
+	laneSinCos(V::load(&batch.PenXRotation[first]), s, c);
+	rotateX(A, c, s);
+	laneSinCos(V::load(&batch.PenZRotation[first]), s, c);
+	rotateZ(A, c, s);
+	translateAxis(A, 1, V(0.2f));
+	laneSinCos(V::load(&batch.PenYRotation[first]), s, c);
+	rotateY(A, c, s);
+	storeAffine(A, &batch.World[BatchPen][first]);
+
+	// Button
+	translateAxis(A, 0, V(0.05f));
+	storeAffine(A, &batch.World[BatchButton][first]);
+}
+
+template <class V>
+static void computeRigBatchLanes(RigBatch &batch, int first, int last)
+{
+	for (int i = first; i < last; i += V::Width)
+		rigKernel<V>(batch, i);
+}
+
+void computeRigBatchRange(RigBatch &batch, int first, int last)
+{
+#if defined(RIGBATCH_AVX)
+	computeRigBatchLanes<LaneAVX>(batch, first, last);
+#elif defined(RIGBATCH_SSE)
+	computeRigBatchLanes<LaneSSE>(batch, first, last);
+#else
+	computeRigBatchLanes<LaneScalar>(batch, first, last);
+#endif
+}
+
+void computeRigBatch(RigBatch &batch)
+{
+	computeRigBatchRange(batch, 0, batch.Count);
+}
+
+const char* rigBatchKernelName(void)
+{
+#if defined(RIGBATCH_AVX)
+	return "avx";
+#elif defined(RIGBATCH_SSE)
+	return "sse2";
+#else
+	return "lanes";
+#endif
+}
+
+
+//-- BENCHMARK --//
+
+static float maxRigBatchError(const RigBatch &a, const RigBatch &b)
+{
+	float err = 0.0f;
+	for (int part = 0; part < NumBatchParts; part++)
+		for (int i = 0; i < a.Count; i++)
+			for (int col = 0; col < 4; col++)
+				for (int r = 0; r < 4; r++)
+					err = glm::max(err, fabsf(a.World[part][i][col][r] - b.World[part][i][col][r]));
+	return err;
+}
+
+// Runs kernel over batch until at least minSeconds passed, returns matrices per second
+static double timeRigBatch(void (*kernel)(RigBatch&), RigBatch &batch, double minSeconds)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	long long iterations = 0;
+	const Clock::time_point start = Clock::now();
+	double elapsed = 0.0;
+	do {
+		kernel(batch);
+		iterations++;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	} while (elapsed < minSeconds);
+
+	return double(iterations) * batch.Count * NumBatchParts / elapsed;
+}
+
+template <class V>
+static void computeRigBatchBench(RigBatch &batch)
+{
+	computeRigBatchLanes<V>(batch, 0, batch.Count);
+}
+
+void benchmarkRigBatch(void)
+{
+	struct Kernel {
+		const char *Name;
+		void (*Run)(RigBatch&);
+	};
+	const Kernel Kernels[] = {
+		{ "scalar", computeRigBatchScalar },
+		{ "lanes", computeRigBatchBench<LaneScalar> },
+#ifdef RIGBATCH_SSE
+		{ "sse2", computeRigBatchBench<LaneSSE> },
+#endif
+#ifdef RIGBATCH_AVX
+		{ "avx", computeRigBatchBench<LaneAVX> },
+#endif
+	};
+	const int NumKernels = sizeof(Kernels) / sizeof(Kernels[0]);
+	const int RigCounts[] = { 1, 1000, 100000 };
+
+	printf("Rig transform benchmark : %d world matrices per rig\n", NumBatchParts);
+	printf("%8s  %-8s %14s %12s\n", "rigs", "kernel", "matrices/s", "max error");
+
+	for (int n = 0; n < 3; n++) {
+		RigBatch reference, batch;
+		reference.resize(RigCounts[n]);
+		batch.resize(RigCounts[n]);
+
+		// Random joint values well outside the interactive limits to exercise range reduction
+		srand(1234);
+		for (int i = 0; i < RigCounts[n]; i++) {
+			batch.BaseXPosition[i] = reference.BaseXPosition[i] = (rand() / float(RAND_MAX) - 0.5f) * 10.0f;
+			batch.BaseZPosition[i] = reference.BaseZPosition[i] = (rand() / float(RAND_MAX) - 0.5f) * 10.0f;
+			batch.TopYRotation[i] = reference.TopYRotation[i] = (rand() / float(RAND_MAX) - 0.5f) * 40.0f;
+			batch.Arm1ZRotation[i] = reference.Arm1ZRotation[i] = (rand() / float(RAND_MAX) - 0.5f) * 4.0f;
+			batch.Arm2ZRotation[i] = reference.Arm2ZRotation[i] = (rand() / float(RAND_MAX) - 0.5f) * 4.0f;
+			batch.PenXRotation[i] = reference.PenXRotation[i] = (rand() / float(RAND_MAX) - 0.5f) * 2.0f;
+			batch.PenZRotation[i] = reference.PenZRotation[i] = (rand() / float(RAND_MAX) - 0.5f) * 2.0f;
+			batch.PenYRotation[i] = reference.PenYRotation[i] = (rand() / float(RAND_MAX) - 0.5f) * 4.0f;
+		}
+		computeRigBatchScalar(reference);
+
+		for (int k = 0; k < NumKernels; k++) {
+			const double rate = timeRigBatch(Kernels[k].Run, batch, 0.25);
+			printf("%8d  %-8s %14.0f %12.2e\n", RigCounts[n], Kernels[k].Name, rate, maxRigBatchError(reference, batch));
+		}
+	}
+}
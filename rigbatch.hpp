@@ -0,0 +1,82 @@
+#ifndef RIGBATCH_HPP
+#define RIGBATCH_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "alignedalloc.hpp"
+
+// Parts of a rig with a world matrix, in the order the rig is drawn
+enum RigBatchPart {
+	BatchBase,
+	BatchTop,
+	BatchArm1,
+	BatchJoint,
+	BatchArm2,
+	BatchPen,
+	BatchButton,
+	NumBatchParts
+};
+
+// Joints of a rig, in the order RigBatch stores them
+enum RigJoint {
+	RigBaseX,
+	RigBaseZ,
+	RigTopY,
+	RigArm1Z,
+	RigArm2Z,
+	RigPenX,
+	RigPenZ,
+	RigPenY,
+	NumRigJoints
+};
+
+// Arrays are padded to whole cache lines of floats, a multiple of every kernel's width
+const int RigBatchPadding = 16;
+
+typedef std::vector<float, AlignedAllocator<float> > RigFloats;
+typedef std::vector<glm::mat4, AlignedAllocator<glm::mat4> > RigMatrices;
+
+// Joint parameters of many rig instances, stored structure-of-arrays so one
+// SIMD lane handles one rig. Arrays are cache line aligned and padded to
+// RigBatchPadding so the kernels never need a scalar tail.
+struct RigBatch {
+	int Count;
+
+	RigFloats BaseXPosition;
+	RigFloats BaseZPosition;
+	RigFloats TopYRotation;
+	RigFloats Arm1ZRotation;
+	RigFloats Arm2ZRotation;
+	RigFloats PenXRotation;
+	RigFloats PenZRotation;
+	RigFloats PenYRotation;
+
+	// Where the rig stands on the floor, the base joints move it from there
+	RigFloats RootX;
+	RigFloats RootZ;
+
+	// World[part][rig], column-major like every other matrix handed to OpenGL
+	RigMatrices World[NumBatchParts];
+
+	RigBatch(void) : Count(0) {}
+	void resize(int count);
+	RigFloats &joint(RigJoint joint);
+	const RigFloats &joint(RigJoint joint) const;
+};
+
+// Reference path : one glm::translate/rotate/scale chain per rig
+void computeRigBatchScalar(RigBatch &batch);
+
+// Fastest kernel compiled in (AVX, then SSE2, then portable lanes)
+void computeRigBatch(RigBatch &batch);
+// Same for rigs [first, last), first a multiple of RigBatchPadding; ranges can run on separate threads
+void computeRigBatchRange(RigBatch &batch, int first, int last);
+
+// Name of the kernel computeRigBatch() dispatches to
+const char* rigBatchKernelName(void);
+
+// CPU micro-benchmark, prints matrices per second for 1, 1k and 100k rigs
+void benchmarkRigBatch(void);
+
+#endif
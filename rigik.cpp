@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <chrono>
+
+#include "rigik.hpp"
+#include "riglanes.hpp"
+
+const IkSettings DefaultIkSettings = {
+	32,				// MaxIterations
+	1e-3f,			// Tolerance
+	0.05f,			// Damping
+	0.5f,			// MaxStep
+	{ 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 0.5f, 0.5f, 0.0f }
+};
+
+// Joints before RigPenY move the tip, the pen spins about the axis its tip lies on
+const int NumTipJoints = RigPenY;
+
+void RigTargets::resize(int count)
+{
+	const int padded = (count + RigBatchPadding - 1) / RigBatchPadding * RigBatchPadding;
+	const int old = (int)Enabled.size();
+
+	X.resize(padded, 0.0f);
+	Y.resize(padded, 0.0f);
+	Z.resize(padded, 0.0f);
+	Enabled.resize(padded, 0.0f);
+	Iterations.resize(padded, 0.0f);
+	Error.resize(padded, 0.0f);
+	// Rigs that were live before and now pad the last line must not be solved
+	for (int i = count; i < old && i < padded; i++)
+		Enabled[i] = 0.0f;
+}
+
+void setRigTarget(RigTargets &targets, int index, const glm::vec3 &target)
+{
+	targets.X[index] = target.x;
+	targets.Y[index] = target.y;
+	targets.Z[index] = target.z;
+	targets.Enabled[index] = 1.0f;
+}
+
+
+//-- KERNEL --//
+
+// Pen tip of V::Width rigs and, per joint, how fast the tip moves with it.
+// Same chain as computeRigBatchScalar(); a turning joint moves the tip by axis x (tip - pivot)
+template <class V>
+static inline void penTipLanes(const V *joints, V rootX, V rootZ, V tip[3], V column[NumTipJoints][3])
+{
+	// The chain is scaled by 0.65 * 2 from Arm2 on, axes are brought back to unit length
+	const V Unscale = float(1.0 / (0.65 * 2.0));
+
+	V s, c;
+	V pivot[NumTipJoints][3], axis[NumTipJoints][3];
+	AffineLanes<V> A;
+
+	// Base
+	for (int col = 0; col < 3; col++)
+		for (int r = 0; r < 3; r++)
+			A.M[col][r] = V(col == r ? 1.0f : 0.0f);
+	A.M[3][0] = rootX + joints[RigBaseX];
+	A.M[3][1] = V(0.5f);
+	A.M[3][2] = rootZ + joints[RigBaseZ];
+
+	// Top turns around world Y
+	for (int r = 0; r < 3; r++) {
+		pivot[RigTopY][r] = A.M[3][r];
+		axis[RigTopY][r] = V(r == 1 ? 1.0f : 0.0f);
+	}
+	laneSinCos(joints[RigTopY], s, c);
+	rotateY(A, c, s);
+	translateAxis(A, 1, V(0.75f));
+
+	// Arm1
+	for (int r = 0; r < 3; r++) {
+		pivot[RigArm1Z][r] = A.M[3][r];
+		axis[RigArm1Z][r] = A.M[2][r];
+	}
+	laneSinCos(joints[RigArm1Z] + V(float((-1) * PI / 4)), s, c);
+	rotateZ(A, c, s);
+	translateAxis(A, 1, V(0.75f));
+	scaleUniform(A, V(0.65f));
+	translateAxis(A, 1, V(2.05f));
+	scaleUniform(A, V(2.0f));
+
+	// Arm2
+	for (int r = 0; r < 3; r++) {
+		pivot[RigArm2Z][r] = A.M[3][r];
+		axis[RigArm2Z][r] = A.M[2][r] * Unscale;
+	}
+	laneSinCos(joints[RigArm2Z] + V(float((-1) * PI / 2.5)), s, c);
+	rotateZ(A, c, s);
+	translateAxis(A, 1, V(0.5f));
+
+	// Pen tilts around X, then around the tilted Z
+	quarterTurnZ(A);
+	translateAxis(A, 0, V(0.6f));
+	for (int r = 0; r < 3; r++) {
+		pivot[RigPenX][r] = A.M[3][r];
+		axis[RigPenX][r] = A.M[0][r] * Unscale;
+	}
+	laneSinCos(joints[RigPenX], s, c);
+	rotateX(A, c, s);
+	for (int r = 0; r < 3; r++) {
+		pivot[RigPenZ][r] = A.M[3][r];
+		axis[RigPenZ][r] = A.M[2][r] * Unscale;
+	}
+	laneSinCos(joints[RigPenZ], s, c);
+	rotateZ(A, c, s);
+	translateAxis(A, 1, V(0.2f + PenTipOffset));
+
+	for (int r = 0; r < 3; r++)
+		tip[r] = A.M[3][r];
+
+	// The base slides the whole rig
+	for (int r = 0; r < 3; r++) {
+		column[RigBaseX][r] = V(r == 0 ? 1.0f : 0.0f);
+		column[RigBaseZ][r] = V(r == 2 ? 1.0f : 0.0f);
+	}
+	for (int j = RigTopY; j < NumTipJoints; j++) {
+		const V dx = tip[0] - pivot[j][0], dy = tip[1] - pivot[j][1], dz = tip[2] - pivot[j][2];
+		column[j][0] = axis[j][1] * dz - axis[j][2] * dy;
+		column[j][1] = axis[j][2] * dx - axis[j][0] * dz;
+		column[j][2] = axis[j][0] * dy - axis[j][1] * dx;
+	}
+}
+
+// y = (J W Jt + Damping^2 I)^-1 e, through the cofactors of the symmetric 3x3 matrix;
+// the damping keeps its determinant away from 0
+template <class V>
+static inline void dampedSolve(const V column[NumTipJoints][3], const V *weight, const IkSettings &settings, const V e[3], V damping2, V y[3])
+{
+	V a00 = damping2, a01 = 0.0f, a02 = 0.0f, a11 = damping2, a12 = 0.0f, a22 = damping2;
+	for (int j = 0; j < NumTipJoints; j++) {
+		if (settings.Weight[j] == 0.0f)
+			continue;
+		const V wx = weight[j] * column[j][0], wy = weight[j] * column[j][1], wz = weight[j] * column[j][2];
+		a00 = a00 + wx * column[j][0];
+		a01 = a01 + wx * column[j][1];
+		a02 = a02 + wx * column[j][2];
+		a11 = a11 + wy * column[j][1];
+		a12 = a12 + wy * column[j][2];
+		a22 = a22 + wz * column[j][2];
+	}
+
+	const V c00 = a11 * a22 - a12 * a12, c01 = a02 * a12 - a01 * a22, c02 = a01 * a12 - a02 * a11;
+	const V c11 = a00 * a22 - a02 * a02, c12 = a01 * a02 - a00 * a12, c22 = a00 * a11 - a01 * a01;
+	const V invDet = V(1.0f) / (a00 * c00 + a01 * c01 + a02 * c02);
+	y[0] = (c00 * e[0] + c01 * e[1] + c02 * e[2]) * invDet;
+	y[1] = (c01 * e[0] + c11 * e[1] + c12 * e[2]) * invDet;
+	y[2] = (c02 * e[0] + c12 * e[1] + c22 * e[2]) * invDet;
+}
+
+// Turning the top is the only way to swing the tip around the base, and with the target behind
+// the tip its gradient vanishes : the solve would settle bent backward. Lanes whose tip and target
+// lie more than a quarter turn apart around the base get the top turned to face the target first.
+// Returns whether any lane turned
+template <class V>
+static inline bool faceTarget(V *joints, const V *low, const V *high, V rootX, V rootZ, const V tip[3], const V target[3], V active)
+{
+	const V baseX = rootX + joints[RigBaseX], baseZ = rootZ + joints[RigBaseZ];
+	const V tipX = tip[0] - baseX, tipZ = tip[2] - baseZ;
+	const V goalX = target[0] - baseX, goalZ = target[2] - baseZ;
+	const V along = tipX * goalX + tipZ * goalZ, across = tipZ * goalX - tipX * goalZ;
+	const V behind = active * laneLess(along, V(0.0f));
+	if (!laneAny(behind))
+		return false;
+	joints[RigTopY] = laneMin(laneMax(joints[RigTopY] + behind * laneAtan2(across, along), low[RigTopY]), high[RigTopY]);
+	return true;
+}
+
+// Where one kernel call reads and writes, every pointer already at the first rig of the lanes
+struct IkLanes {
+	float *Joints[NumRigJoints];
+	const float *Min[NumRigJoints];
+	const float *Max[NumRigJoints];
+	const float *RootX, *RootZ;
+	const float *Target[3];
+	const float *Enabled;
+	float *Iterations;
+	float *Error;
+};
+
+template <class V>
+static inline void ikKernel(const IkLanes &rigs, const IkSettings &settings)
+{
+	V joints[NumTipJoints], low[NumTipJoints], high[NumTipJoints];
+	for (int j = 0; j < NumTipJoints; j++) {
+		joints[j] = V::load(rigs.Joints[j]);
+		low[j] = V::load(rigs.Min[j]);
+		high[j] = V::load(rigs.Max[j]);
+	}
+	const V rootX = V::load(rigs.RootX), rootZ = V::load(rigs.RootZ);
+	const V target[3] = { V::load(rigs.Target[0]), V::load(rigs.Target[1]), V::load(rigs.Target[2]) };
+	const V tolerance2 = settings.Tolerance * settings.Tolerance;
+	const V damping2 = settings.Damping * settings.Damping;
+
+	// Past the edge of the workspace the steps can wander off, lanes keep the closest pose they passed
+	V best[NumTipJoints], bestError2 = FLT_MAX;
+	V active = V::load(rigs.Enabled);
+	V iterations = 0.0f;
+	for (int iteration = 0; ; iteration++) {
+		V tip[3], column[NumTipJoints][3];
+		penTipLanes(joints, rootX, rootZ, tip, column);
+		if (iteration == 0 && settings.Weight[RigTopY] != 0.0f && faceTarget(joints, low, high, rootX, rootZ, tip, target, active))
+			penTipLanes(joints, rootX, rootZ, tip, column);
+
+		V e[3] = { target[0] - tip[0], target[1] - tip[1], target[2] - tip[2] };
+		const V error2 = e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
+		const V closer = laneLess(error2, bestError2);
+		for (int j = 0; j < NumTipJoints; j++)
+			best[j] = iteration == 0 ? joints[j] : best[j] + closer * (joints[j] - best[j]);
+		bestError2 = laneMin(bestError2, error2);
+		active = active * laneLess(tolerance2, error2);
+		if (iteration == settings.MaxIterations || !laneAny(active))
+			break;
+		iterations = iterations + active;
+
+		// Far targets are approached in steps of at most MaxStep
+		const V reach = laneMin(V(1.0f), V(settings.MaxStep) / laneSqrt(laneMax(error2, tolerance2)));
+		for (int r = 0; r < 3; r++)
+			e[r] = e[r] * reach;
+
+		// A joint resting on a limit the step pushes it past gives its share to the others
+		V weight[NumTipJoints], y[3];
+		for (int j = 0; j < NumTipJoints; j++)
+			weight[j] = settings.Weight[j];
+		dampedSolve(column, weight, settings, e, damping2, y);
+		V blocked = 0.0f;
+		for (int j = 0; j < NumTipJoints; j++) {
+			if (settings.Weight[j] == 0.0f)
+				continue;
+			const V step = column[j][0] * y[0] + column[j][1] * y[1] + column[j][2] * y[2];
+			const V pinned = (V(1.0f) - laneLess(low[j], joints[j])) * laneLess(step, V(0.0f))
+				+ (V(1.0f) - laneLess(joints[j], high[j])) * laneLess(V(0.0f), step);
+			weight[j] = weight[j] * (V(1.0f) - pinned);
+			blocked = laneMax(blocked, pinned);
+		}
+		if (laneAny(blocked))
+			dampedSolve(column, weight, settings, e, damping2, y);
+
+		// Finished lanes take no step
+		for (int j = 0; j < NumTipJoints; j++) {
+			if (settings.Weight[j] == 0.0f)
+				continue;
+			const V step = active * weight[j] * (column[j][0] * y[0] + column[j][1] * y[1] + column[j][2] * y[2]);
+			joints[j] = laneMin(laneMax(joints[j] + step, low[j]), high[j]);
+		}
+	}
+
+	for (int j = 0; j < NumTipJoints; j++)
+		best[j].store(rigs.Joints[j]);
+	iterations.store(rigs.Iterations);
+	laneSqrt(bestError2).store(rigs.Error);
+}
+
+static IkLanes ikLanes(RigWorld &world, float *targetX, float *targetY, float *targetZ, float *enabled, float *iterations, float *error, int first)
+{
+	IkLanes rigs;
+	for (int j = 0; j < NumRigJoints; j++) {
+		rigs.Joints[j] = &world.Rigs.joint(RigJoint(j))[first];
+		rigs.Min[j] = &world.MinJoint[j][first];
+		rigs.Max[j] = &world.MaxJoint[j][first];
+	}
+	rigs.RootX = &world.Rigs.RootX[first];
+	rigs.RootZ = &world.Rigs.RootZ[first];
+	rigs.Target[0] = targetX;
+	rigs.Target[1] = targetY;
+	rigs.Target[2] = targetZ;
+	rigs.Enabled = enabled;
+	rigs.Iterations = iterations;
+	rigs.Error = error;
+	return rigs;
+}
+
+template <class V>
+static void solveRigIkLanes(RigWorld &world, RigTargets &targets, int first, int last, const IkSettings &settings)
+{
+	for (int i = first; i < last; i += V::Width) {
+		const IkLanes rigs = ikLanes(world, &targets.X[i], &targets.Y[i], &targets.Z[i], &targets.Enabled[i], &targets.Iterations[i], &targets.Error[i], i);
+		ikKernel<V>(rigs, settings);
+	}
+}
+
+IkResult solveRigIk(RigWorld &world, int index, const glm::vec3 &target, const IkSettings &settings)
+{
+	float x = target.x, y = target.y, z = target.z, enabled = 1.0f, iterations, error;
+	const IkLanes rigs = ikLanes(world, &x, &y, &z, &enabled, &iterations, &error, index);
+	ikKernel<LaneScalar>(rigs, settings);
+
+	IkResult result = { int(iterations), error };
+	return result;
+}
+
+void solveRigIkRange(RigWorld &world, RigTargets &targets, int first, int last, const IkSettings &settings)
+{
+#if defined(RIGBATCH_AVX)
+	solveRigIkLanes<LaneAVX>(world, targets, first, last, settings);
+#elif defined(RIGBATCH_SSE)
+	solveRigIkLanes<LaneSSE>(world, targets, first, last, settings);
+#else
+	solveRigIkLanes<LaneScalar>(world, targets, first, last, settings);
+#endif
+}
+
+struct IkJob {
+	RigTargets *Targets;
+	const IkSettings *Settings;
+};
+
+static void solveRigChunk(RigWorld &world, int first, int last, void *data)
+{
+	const IkJob &job = *(const IkJob*)data;
+	solveRigIkRange(world, *job.Targets, first, last, *job.Settings);
+}
+
+void solveRigIkWorld(RigWorld &world, RigTargets &targets, JobSystem &jobs, const IkSettings &settings)
+{
+	IkJob job = { &targets, &settings };
+	parallelForRigs(world, jobs, solveRigChunk, &job);
+}
+
+glm::vec3 rigPenTip(const RigWorld &world, int index)
+{
+	return glm::vec3(world.Rigs.World[BatchPen][index] * glm::vec4(0.0f, PenTipOffset, 0.0f, 1.0f));
+}
+
+
+//-- BENCHMARK --//
+
+typedef void (*IkKernel)(RigWorld&, RigTargets&, int, int, const IkSettings&);
+
+struct IkRun {
+	double Seconds;			// per solve of every rig
+	double Iterations;		// average per rig
+	int MaxIterations;
+	int Reached;
+	float MaxError;
+};
+
+static void restJoints(RigWorld &world)
+{
+	for (int j = 0; j < NumRigJoints; j++)
+		for (int i = 0; i < world.Rigs.Count; i++)
+			world.Rigs.joint(RigJoint(j))[i] = 0.0f;
+}
+
+static IkRun ikRunStats(const RigWorld &world, const RigTargets &targets, const IkSettings &settings, double seconds)
+{
+	IkRun run = { seconds, 0.0, 0, 0, 0.0f };
+	for (int i = 0; i < world.Rigs.Count; i++) {
+		run.Iterations += targets.Iterations[i];
+		run.MaxIterations = glm::max(run.MaxIterations, int(targets.Iterations[i]));
+		run.MaxError = glm::max(run.MaxError, targets.Error[i]);
+		if (targets.Error[i] <= settings.Tolerance)
+			run.Reached++;
+	}
+	run.Iterations /= double(world.Rigs.Count);
+	return run;
+}
+
+static void printIkRun(int rigs, const char *kernel, const char *scenario, const IkRun &run)
+{
+	printf("%8d %7s %9s %9.2f %9d %8.2f%% %10.5f %11.3f %12.0f\n", rigs, kernel, scenario, run.Iterations, run.MaxIterations,
+		100.0 * run.Reached / rigs, run.MaxError, run.Seconds * 1e6 / rigs, rigs / run.Seconds);
+}
+
+void benchmarkRigIk(void)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	struct Kernel {
+		const char *Name;
+		IkKernel Run;
+	};
+	const Kernel Kernels[] = {
+		{ "lanes", solveRigIkLanes<LaneScalar> },
+#ifdef RIGBATCH_SSE
+		{ "sse2", solveRigIkLanes<LaneSSE> },
+#endif
+#ifdef RIGBATCH_AVX
+		{ "avx", solveRigIkLanes<LaneAVX> },
+#endif
+	};
+	const int NumKernels = sizeof(Kernels) / sizeof(Kernels[0]);
+	const int RigCounts[] = { 1000, 10000, 100000 };
+	const int TrackSteps = 60;
+
+	// Same limits as the interactive arm
+	const RigLimits limits = {
+		{ -5.0f, -5.0f, -FLT_MAX, float((-1) * PI / 4), float((-1) * PI / 3), float((-1) * PI / 3), float((-1) * PI / 4), float((-1) * PI / 2) },
+		{ 5.0f, 5.0f, FLT_MAX, float(2 * PI / 3), float(PI), float(PI / 3), float(PI / 4), float(PI / 2) }
+	};
+	const IkSettings &settings = DefaultIkSettings;
+
+	printf("Pen tip IK : damped least squares, at most %d iterations to %g, one thread\n", settings.MaxIterations, settings.Tolerance);
+	printf("  rest : from the rest pose to a random reachable target\n");
+	printf("  track : targets moving 0.01 per solve, %d solves from the last result; up to 0.2 off a\n", TrackSteps);
+	printf("          reachable point, a few leave the workspace and can only be approached\n");
+	printf("%8s %7s %9s %9s %9s %9s %10s %11s %12s\n", "targets", "kernel", "case", "avg iter", "max iter", "reached", "max error", "us/target", "targets/s");
+
+	for (int n = 0; n < 3; n++) {
+		const int count = RigCounts[n];
+		RigWorld world;
+		for (int i = 0; i < count; i++)
+			addRig(world, limits, 3.0f * (i % 1000), 3.0f * (i / 1000));
+
+		// Targets are where random poses put the tip, so every one of them can be reached, also the
+		// many behind the rest pose that the top has to turn around to
+		srand(25);
+		for (int i = 0; i < count; i++)
+			for (int j = RigTopY; j < NumTipJoints; j++) {
+				const float low = j == RigTopY ? float(-PI) : limits.Min[j];
+				const float high = j == RigTopY ? float(PI) : limits.Max[j];
+				setRigJoint(world, i, RigJoint(j), low + (high - low) * float(rand()) / float(RAND_MAX));
+			}
+		computeRigBatch(world.Rigs);
+		std::vector<glm::vec3> goals(count);
+		RigTargets targets;
+		targets.resize(count);
+		for (int i = 0; i < count; i++) {
+			goals[i] = rigPenTip(world, i);
+			setRigTarget(targets, i, goals[i]);
+		}
+
+		for (int k = 0; k < NumKernels; k++) {
+			// Every repeat starts from rest again, only the solves are timed
+			double seconds = 0.0;
+			int repeats = 0;
+			do {
+				restJoints(world);
+				const Clock::time_point start = Clock::now();
+				Kernels[k].Run(world, targets, 0, count, settings);
+				seconds += std::chrono::duration<double>(Clock::now() - start).count();
+				repeats++;
+			} while (seconds < 0.25 && repeats < 100);
+			printIkRun(count, Kernels[k].Name, "rest", ikRunStats(world, targets, settings, seconds / repeats));
+
+			// Each target circles its goal, the solve before it is the starting pose. Goals near the
+			// edge of the workspace push some of them out of it
+			IkRun track = { 0.0, 0.0, 0, 0, 0.0f };
+			for (int step = 1; step <= TrackSteps; step++) {
+				const float angle = step * 0.01f / 0.1f;
+				for (int i = 0; i < count; i++)
+					setRigTarget(targets, i, goals[i] + 0.1f * glm::vec3(cosf(angle) - 1.0f, 0.0f, sinf(angle)));
+				const Clock::time_point start = Clock::now();
+				Kernels[k].Run(world, targets, 0, count, settings);
+				const IkRun run = ikRunStats(world, targets, settings, std::chrono::duration<double>(Clock::now() - start).count());
+				track.Seconds += run.Seconds / TrackSteps;
+				track.Iterations += run.Iterations / TrackSteps;
+				track.MaxIterations = glm::max(track.MaxIterations, run.MaxIterations);
+				track.Reached = step == 1 ? run.Reached : glm::min(track.Reached, run.Reached);
+				track.MaxError = glm::max(track.MaxError, run.MaxError);
+			}
+			printIkRun(count, Kernels[k].Name, "track", track);
+
+			for (int i = 0; i < count; i++)
+				setRigTarget(targets, i, goals[i]);
+		}
+	}
+}
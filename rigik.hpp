@@ -0,0 +1,66 @@
+#ifndef RIGIK_HPP
+#define RIGIK_HPP
+
+#include <glm/glm.hpp>
+
+#include "rigworld.hpp"
+
+// Inverse kinematics for the pen tip : moves a rig's joints, within its limits, until the tip
+// of the pen reaches a world-space target.
+// Damped least squares on the analytic Jacobian of the joint chain : every iteration solves
+//   dq = W Jt (J W Jt + Damping^2 I)^-1 (target - tip)
+// a 3x3 system per rig, then clamps the joints into their limits. W weighs how much each
+// joint takes part, 0 keeps it where it is.
+// Solves start from the current joints, so a target that moves a little each frame takes a
+// few iterations. Rigs are solved a SIMD register of lanes at a time like computeRigBatch(),
+// a lane stops moving once within Tolerance; nothing is allocated while solving.
+// A target out of reach leaves the rig at the closest pose the solve passed, Error tells how far.
+
+// The pen tip in pen model space, the lowest point of pen.obj
+const float PenTipOffset = -0.481087f;
+
+struct IkSettings {
+	int MaxIterations;
+	float Tolerance;				// distance from the target that counts as reached
+	float Damping;					// > 0, trades convergence speed for stability near singular poses
+	float MaxStep;					// longest reach toward the target per iteration, the linearization holds that far
+	float Weight[NumRigJoints];
+};
+
+// The top, both arms and the pen tilt take part; only the base slide and the pen spin are held,
+// the base stays put and spinning the pen never moves its tip
+extern const IkSettings DefaultIkSettings;
+
+// One target per rig, indexed like the world's dense rigs and padded the same way.
+// Results hold what the last solve left.
+struct RigTargets {
+	RigFloats X, Y, Z;
+	RigFloats Enabled;				// 1 : solve this rig, 0 : leave it alone
+	RigFloats Iterations;			// whole numbers, floats so the kernels store them like any lane
+	RigFloats Error;				// tip to target distance
+
+	void resize(int count);			// new and padding rigs start disabled
+};
+
+void setRigTarget(RigTargets &targets, int index, const glm::vec3 &target);
+
+struct IkResult {
+	int Iterations;
+	float Error;
+};
+
+// Solves a single rig at any dense index
+IkResult solveRigIk(RigWorld &world, int index, const glm::vec3 &target, const IkSettings &settings);
+// Solves the enabled rigs of [first, last), first a multiple of RigBatchPadding; ranges can run on separate threads.
+// Only the joints change, updateRigRange() brings the world matrices along
+void solveRigIkRange(RigWorld &world, RigTargets &targets, int first, int last, const IkSettings &settings);
+void solveRigIkWorld(RigWorld &world, RigTargets &targets, JobSystem &jobs, const IkSettings &settings);
+
+// Where the pen tip is after the last update of the rig's world matrices
+glm::vec3 rigPenTip(const RigWorld &world, int index);
+
+// Random reachable targets for 1k, 10k and 100k rigs, solved from the rest pose and then tracked
+// as they move; prints iterations, error and time per target for every kernel compiled in
+void benchmarkRigIk(void);
+
+#endif
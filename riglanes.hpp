@@ -0,0 +1,202 @@
+#ifndef RIGLANES_HPP
+#define RIGLANES_HPP
+
+#include <math.h>
+
+// SIMD lanes shared by the rig kernels : thin wrappers over a float, an SSE and an AVX
+// register so a kernel is written once for every width, one rig per lane, plus the
+// sin/cos and affine helpers the rig chain is built from.
+// Comparisons give masks of 1.0 and 0.0, so a kernel turns lanes off by multiplying.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RIGBATCH_SSE 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#define RIGBATCH_AVX 1
+#include <immintrin.h>
+#endif
+
+#ifndef PI
+#define PI 3.1415926535897
+#endif
+
+struct LaneScalar {
+	enum { Width = 1 };
+	float v;
+	LaneScalar(void) {}
+	LaneScalar(float s) : v(s) {}
+	static LaneScalar load(const float *p) { return LaneScalar(*p); }
+	void store(float *p) const { *p = v; }
+};
+static inline LaneScalar operator+(LaneScalar a, LaneScalar b) { return LaneScalar(a.v + b.v); }
+static inline LaneScalar operator-(LaneScalar a, LaneScalar b) { return LaneScalar(a.v - b.v); }
+static inline LaneScalar operator*(LaneScalar a, LaneScalar b) { return LaneScalar(a.v * b.v); }
+static inline LaneScalar operator/(LaneScalar a, LaneScalar b) { return LaneScalar(a.v / b.v); }
+static inline LaneScalar laneMin(LaneScalar a, LaneScalar b) { return LaneScalar(a.v < b.v ? a.v : b.v); }
+static inline LaneScalar laneMax(LaneScalar a, LaneScalar b) { return LaneScalar(a.v > b.v ? a.v : b.v); }
+static inline LaneScalar laneRound(LaneScalar a) { return LaneScalar(floorf(a.v + 0.5f)); }
+static inline LaneScalar laneSqrt(LaneScalar a) { return LaneScalar(sqrtf(a.v)); }
+static inline LaneScalar laneLess(LaneScalar a, LaneScalar b) { return LaneScalar(a.v < b.v ? 1.0f : 0.0f); }
+static inline bool laneAny(LaneScalar mask) { return mask.v != 0.0f; }
+
+#ifdef RIGBATCH_SSE
+struct LaneSSE {
+	enum { Width = 4 };
+	__m128 v;
+	LaneSSE(void) {}
+	LaneSSE(__m128 x) : v(x) {}
+	LaneSSE(float s) : v(_mm_set1_ps(s)) {}
+	static LaneSSE load(const float *p) { return LaneSSE(_mm_load_ps(p)); }
+	void store(float *p) const { _mm_store_ps(p, v); }
+};
+static inline LaneSSE operator+(LaneSSE a, LaneSSE b) { return LaneSSE(_mm_add_ps(a.v, b.v)); }
+static inline LaneSSE operator-(LaneSSE a, LaneSSE b) { return LaneSSE(_mm_sub_ps(a.v, b.v)); }
+static inline LaneSSE operator*(LaneSSE a, LaneSSE b) { return LaneSSE(_mm_mul_ps(a.v, b.v)); }
+static inline LaneSSE operator/(LaneSSE a, LaneSSE b) { return LaneSSE(_mm_div_ps(a.v, b.v)); }
+static inline LaneSSE laneMin(LaneSSE a, LaneSSE b) { return LaneSSE(_mm_min_ps(a.v, b.v)); }
+static inline LaneSSE laneMax(LaneSSE a, LaneSSE b) { return LaneSSE(_mm_max_ps(a.v, b.v)); }
+// Round to nearest through the integer conversion, SSE2 has no round instruction
+static inline LaneSSE laneRound(LaneSSE a) { return LaneSSE(_mm_cvtepi32_ps(_mm_cvtps_epi32(a.v))); }
+static inline LaneSSE laneSqrt(LaneSSE a) { return LaneSSE(_mm_sqrt_ps(a.v)); }
+static inline LaneSSE laneLess(LaneSSE a, LaneSSE b) { return LaneSSE(_mm_and_ps(_mm_cmplt_ps(a.v, b.v), _mm_set1_ps(1.0f))); }
+static inline bool laneAny(LaneSSE mask) { return _mm_movemask_ps(_mm_cmpneq_ps(mask.v, _mm_setzero_ps())) != 0; }
+#endif
+
+#ifdef RIGBATCH_AVX
+struct LaneAVX {
+	enum { Width = 8 };
+	__m256 v;
+	LaneAVX(void) {}
+	LaneAVX(__m256 x) : v(x) {}
+	LaneAVX(float s) : v(_mm256_set1_ps(s)) {}
+	static LaneAVX load(const float *p) { return LaneAVX(_mm256_load_ps(p)); }
+	void store(float *p) const { _mm256_store_ps(p, v); }
+};
+static inline LaneAVX operator+(LaneAVX a, LaneAVX b) { return LaneAVX(_mm256_add_ps(a.v, b.v)); }
+static inline LaneAVX operator-(LaneAVX a, LaneAVX b) { return LaneAVX(_mm256_sub_ps(a.v, b.v)); }
+static inline LaneAVX operator*(LaneAVX a, LaneAVX b) { return LaneAVX(_mm256_mul_ps(a.v, b.v)); }
+static inline LaneAVX operator/(LaneAVX a, LaneAVX b) { return LaneAVX(_mm256_div_ps(a.v, b.v)); }
+static inline LaneAVX laneMin(LaneAVX a, LaneAVX b) { return LaneAVX(_mm256_min_ps(a.v, b.v)); }
+static inline LaneAVX laneMax(LaneAVX a, LaneAVX b) { return LaneAVX(_mm256_max_ps(a.v, b.v)); }
+static inline LaneAVX laneRound(LaneAVX a) { return LaneAVX(_mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)); }
+static inline LaneAVX laneSqrt(LaneAVX a) { return LaneAVX(_mm256_sqrt_ps(a.v)); }
+static inline LaneAVX laneLess(LaneAVX a, LaneAVX b) { return LaneAVX(_mm256_and_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ), _mm256_set1_ps(1.0f))); }
+static inline bool laneAny(LaneAVX mask) { return _mm256_movemask_ps(_mm256_cmp_ps(mask.v, _mm256_setzero_ps(), _CMP_NEQ_OQ)) != 0; }
+#endif
+
+// sin(x) for any x : wrap to [-PI, PI], fold to [-PI/2, PI/2], then an odd Taylor polynomial
+// (error below 1e-7 on the folded range, no branches so it vectorizes as is)
+template <class V>
+static inline V laneSin(V x)
+{
+	const V Pi = float(PI);
+	const V TwoPi = float(2 * PI);
+	const V InvTwoPi = float(1.0 / (2 * PI));
+
+	x = x - TwoPi * laneRound(x * InvTwoPi);
+	x = laneMin(x, Pi - x);
+	x = laneMax(x, (V(0.0f) - Pi) - x);
+
+	const V x2 = x * x;
+	V p = V(-1.0f / 39916800.0f);
+	p = p * x2 + V(1.0f / 362880.0f);
+	p = p * x2 + V(-1.0f / 5040.0f);
+	p = p * x2 + V(1.0f / 120.0f);
+	p = p * x2 + V(-1.0f / 6.0f);
+	p = p * x2 + V(1.0f);
+	return p * x;
+}
+
+template <class V>
+static inline void laneSinCos(V x, V &s, V &c)
+{
+	s = laneSin(x);
+	c = laneSin(x + V(float(PI / 2)));
+}
+
+// atan2(y, x) : atan of the smaller over the larger magnitude by an odd polynomial (error below
+// 2e-5 on [0, 1]), then mirrored into the right octant with masks instead of branches
+template <class V>
+static inline V laneAtan2(V y, V x)
+{
+	const V ax = laneMax(x, V(0.0f) - x), ay = laneMax(y, V(0.0f) - y);
+	const V a = laneMin(ax, ay) / laneMax(laneMax(ax, ay), V(1e-30f));
+	const V a2 = a * a;
+	V p = V(-0.01172120f);
+	p = p * a2 + V(0.05265332f);
+	p = p * a2 + V(-0.11643287f);
+	p = p * a2 + V(0.19354346f);
+	p = p * a2 + V(-0.33262347f);
+	p = p * a2 + V(0.99997726f);
+	V r = p * a;
+
+	r = r + laneLess(ax, ay) * (V(float(PI / 2)) - r - r);
+	r = r + laneLess(x, V(0.0f)) * (V(float(PI)) - r - r);
+	return r - laneLess(y, V(0.0f)) * (r + r);
+}
+
+// Affine matrix for V::Width rigs : M[column][row], column 3 is the translation
+template <class V>
+struct AffineLanes {
+	V M[4][3];
+};
+
+template <class V>
+static inline void rotateX(AffineLanes<V> &A, V c, V s)
+{
+	for (int r = 0; r < 3; r++) {
+		const V a = A.M[1][r], b = A.M[2][r];
+		A.M[1][r] = a * c + b * s;
+		A.M[2][r] = b * c - a * s;
+	}
+}
+
+template <class V>
+static inline void rotateY(AffineLanes<V> &A, V c, V s)
+{
+	for (int r = 0; r < 3; r++) {
+		const V a = A.M[0][r], b = A.M[2][r];
+		A.M[0][r] = a * c - b * s;
+		A.M[2][r] = a * s + b * c;
+	}
+}
+
+template <class V>
+static inline void rotateZ(AffineLanes<V> &A, V c, V s)
+{
+	for (int r = 0; r < 3; r++) {
+		const V a = A.M[0][r], b = A.M[1][r];
+		A.M[0][r] = a * c + b * s;
+		A.M[1][r] = b * c - a * s;
+	}
+}
+
+template <class V>
+static inline void scaleUniform(AffineLanes<V> &A, V k)
+{
+	for (int col = 0; col < 3; col++)
+		for (int r = 0; r < 3; r++)
+			A.M[col][r] = A.M[col][r] * k;
+}
+
+// Rotation by a quarter turn around Z is a column swap
+template <class V>
+static inline void quarterTurnZ(AffineLanes<V> &A)
+{
+	for (int r = 0; r < 3; r++) {
+		const V a = A.M[0][r];
+		A.M[0][r] = A.M[1][r];
+		A.M[1][r] = V(0.0f) - a;
+	}
+}
+
+// Translate along a single local axis, every offset in the rig chain is axis aligned
+template <class V>
+static inline void translateAxis(AffineLanes<V> &A, int axis, V d)
+{
+	for (int r = 0; r < 3; r++)
+		A.M[3][r] = A.M[3][r] + A.M[axis][r] * d;
+}
+
+#endif
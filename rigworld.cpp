@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <chrono>
+
+#include "rigworld.hpp"
+
+static float clampJoint(float value, float low, float high)
+{
+	return value < low ? low : (value > high ? high : value);
+}
+
+RigHandle addRig(RigWorld &world, const RigLimits &limits, float rootX, float rootZ)
+{
+	const int index = world.Rigs.Count;
+	world.Rigs.resize(index + 1);
+	for (int j = 0; j < NumRigJoints; j++) {
+		world.MinJoint[j].resize(world.Rigs.BaseXPosition.size(), 0.0f);
+		world.MaxJoint[j].resize(world.Rigs.BaseXPosition.size(), 0.0f);
+	}
+	world.Rigs.RootX[index] = rootX;
+	world.Rigs.RootZ[index] = rootZ;
+	setRigLimits(world, index, limits);
+	for (int j = 0; j < NumRigJoints; j++)
+		setRigJoint(world, index, RigJoint(j), 0.0f);
+
+	unsigned int slot;
+	if (!world.FreeSlots.empty()) {
+		slot = world.FreeSlots.back();
+		world.FreeSlots.pop_back();
+	}
+	else {
+		slot = (unsigned int)world.SlotDense.size();
+		world.SlotDense.push_back(0);
+		world.SlotGeneration.push_back(0);
+	}
+	world.SlotDense[slot] = (unsigned int)index;
+	world.DenseSlot.push_back(slot);
+
+	RigHandle rig = { slot, world.SlotGeneration[slot] };
+	return rig;
+}
+
+bool removeRig(RigWorld &world, RigHandle rig)
+{
+	const int index = rigIndex(world, rig);
+	if (index < 0)
+		return false;
+
+	// The last rig fills the hole, joints, limits and matrices alike
+	const int last = world.Rigs.Count - 1;
+	if (index != last) {
+		RigBatch &rigs = world.Rigs;
+		for (int j = 0; j < NumRigJoints; j++) {
+			rigs.joint(RigJoint(j))[index] = rigs.joint(RigJoint(j))[last];
+			world.MinJoint[j][index] = world.MinJoint[j][last];
+			world.MaxJoint[j][index] = world.MaxJoint[j][last];
+		}
+		rigs.RootX[index] = rigs.RootX[last];
+		rigs.RootZ[index] = rigs.RootZ[last];
+		for (int part = 0; part < NumBatchParts; part++)
+			rigs.World[part][index] = rigs.World[part][last];
+
+		const unsigned int moved = world.DenseSlot[last];
+		world.DenseSlot[index] = moved;
+		world.SlotDense[moved] = (unsigned int)index;
+	}
+	world.DenseSlot.pop_back();
+	world.Rigs.resize(last);
+
+	world.SlotGeneration[rig.Slot]++;
+	world.FreeSlots.push_back(rig.Slot);
+	return true;
+}
+
+int rigIndex(const RigWorld &world, RigHandle rig)
+{
+	if (rig.Slot >= world.SlotDense.size() || world.SlotGeneration[rig.Slot] != rig.Generation)
+		return -1;
+	return (int)world.SlotDense[rig.Slot];
+}
+
+RigHandle rigHandle(const RigWorld &world, int index)
+{
+	const unsigned int slot = world.DenseSlot[index];
+	RigHandle rig = { slot, world.SlotGeneration[slot] };
+	return rig;
+}
+
+float rigJoint(const RigWorld &world, int index, RigJoint joint)
+{
+	return world.Rigs.joint(joint)[index];
+}
+
+void setRigJoint(RigWorld &world, int index, RigJoint joint, float value)
+{
+	world.Rigs.joint(joint)[index] = clampJoint(value, world.MinJoint[joint][index], world.MaxJoint[joint][index]);
+}
+
+void moveRigJoint(RigWorld &world, int index, RigJoint joint, float delta)
+{
+	setRigJoint(world, index, joint, rigJoint(world, index, joint) + delta);
+}
+
+void setRigLimits(RigWorld &world, int index, const RigLimits &limits)
+{
+	for (int j = 0; j < NumRigJoints; j++) {
+		world.MinJoint[j][index] = limits.Min[j];
+		world.MaxJoint[j][index] = limits.Max[j];
+	}
+}
+
+struct RigRangeJob {
+	RigWorld *World;
+	RigRangeFunction Function;
+	void *Data;
+};
+
+static void runRigRange(void *data, int first, int last)
+{
+	RigRangeJob *job = (RigRangeJob*)data;
+	job->Function(*job->World, first, last, job->Data);
+}
+
+void parallelForRigs(RigWorld &world, JobSystem &jobs, RigRangeFunction function, void *data)
+{
+	RigRangeJob job = { &world, function, data };
+	parallelFor(jobs, runRigRange, &job, world.Rigs.Count, RigWorldChunk);
+}
+
+void updateRigRange(RigWorld &world, int first, int last)
+{
+	// One pass per joint array over contiguous floats, simple enough for the compiler to vectorize
+	for (int j = 0; j < NumRigJoints; j++) {
+		float *values = &world.Rigs.joint(RigJoint(j))[0];
+		const float *low = &world.MinJoint[j][0];
+		const float *high = &world.MaxJoint[j][0];
+		for (int i = first; i < last; i++)
+			values[i] = clampJoint(values[i], low[i], high[i]);
+	}
+	computeRigBatchRange(world.Rigs, first, last);
+}
+
+static void updateRigChunk(RigWorld &world, int first, int last, void *)
+{
+	updateRigRange(world, first, last);
+}
+
+void updateRigWorld(RigWorld &world, JobSystem &jobs)
+{
+	parallelForRigs(world, jobs, updateRigChunk, NULL);
+}
+
+
+//-- BENCHMARK --//
+
+// What a fixed update does to every rig : one joint steps, then clamp and matrices
+static void stepRigChunk(RigWorld &world, int first, int last, void *data)
+{
+	const float delta = *(const float*)data;
+	for (int r = first; r < last; r++) {
+		float &value = world.Rigs.joint(RigJoint(r % NumRigJoints))[r];
+		value += delta;
+	}
+	updateRigRange(world, first, last);
+}
+
+void benchmarkRigWorld(int maxThreads)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const int RigCounts[] = { 10000, 100000, 1000000 };
+	if (maxThreads <= 0)
+		maxThreads = (int)std::thread::hardware_concurrency();
+	if (maxThreads <= 0)
+		maxThreads = 1;
+	std::vector<int> threadCounts;
+	for (int t = 1; t < maxThreads; t *= 2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(maxThreads);
+
+	RigLimits limits;
+	for (int j = 0; j < NumRigJoints; j++) {
+		limits.Min[j] = -1.0f;
+		limits.Max[j] = 1.0f;
+	}
+
+	printf("Rig world update : joint step + clamp + %d world matrices per rig, %s kernel, %d rigs per job\n",
+		NumBatchParts, rigBatchKernelName(), RigWorldChunk);
+	printf("%8s %8s %12s %14s %9s %9s\n", "rigs", "threads", "ms/update", "rigs/s", "speedup", "stolen");
+
+	for (int n = 0; n < 3; n++) {
+		RigWorld world;
+		for (int i = 0; i < RigCounts[n]; i++)
+			addRig(world, limits, float(i % 1000), float(i / 1000));
+
+		double single = 0.0;
+		for (size_t t = 0; t < threadCounts.size(); t++) {
+			JobSystem jobs;
+			startJobSystem(jobs, threadCounts[t]);
+
+			// Steps alternate in sign so the joints stay inside their limits
+			float delta = 0.01f;
+			parallelForRigs(world, jobs, stepRigChunk, &delta);
+			jobs.Stolen = 0;
+
+			long long updates = 0;
+			double elapsed = 0.0;
+			const Clock::time_point start = Clock::now();
+			do {
+				delta = -delta;
+				parallelForRigs(world, jobs, stepRigChunk, &delta);
+				updates++;
+				elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+			} while (elapsed < 0.25 || updates < 3);
+
+			const double ms = elapsed * 1000.0 / double(updates);
+			if (t == 0)
+				single = ms;
+			printf("%8d %8d %12.3f %14.0f %8.2fx %9.0f\n", RigCounts[n], threadCounts[t], ms,
+				RigCounts[n] / (ms / 1000.0), single / ms, double(jobs.Stolen) / double(updates));
+			stopJobSystem(jobs);
+		}
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef RIGWORLD_HPP
+#define RIGWORLD_HPP
+
+#include <vector>
+
+#include "rigbatch.hpp"
+#include "jobsystem.hpp"
+
+// Every rig of the scene : joints, joint limits and world matrices in one RigBatch plus
+// limit arrays of the same layout, packed so rigs [0, count) are all live.
+// Rigs are referred to by handles that stay valid while other rigs come and go; removing
+// a rig moves the last one into its place, so both add and remove are O(1) and a dense
+// index is only good until the next removal.
+// Updates walk the arrays in chunks of whole cache lines, one job per chunk.
+
+const int RigWorldChunk = 1024;		// rigs per parallel update job, a multiple of RigBatchPadding
+
+struct RigHandle {
+	unsigned int Slot;
+	unsigned int Generation;
+};
+
+const RigHandle NullRig = { ~0u, 0 };
+
+struct RigLimits {
+	float Min[NumRigJoints];
+	float Max[NumRigJoints];
+};
+
+struct RigWorld {
+	RigBatch Rigs;							// dense, Rigs.Count live rigs
+	RigFloats MinJoint[NumRigJoints];		// per-rig limits, dense like the joints
+	RigFloats MaxJoint[NumRigJoints];
+
+	std::vector<unsigned int> DenseSlot;		// dense index -> slot
+	std::vector<unsigned int> SlotDense;		// slot -> dense index
+	std::vector<unsigned int> SlotGeneration;	// bumped when the slot's rig is removed
+	std::vector<unsigned int> FreeSlots;
+};
+
+// Joints start at zero clamped into limits, the rig stands at (rootX, rootZ)
+RigHandle addRig(RigWorld &world, const RigLimits &limits, float rootX, float rootZ);
+// Swap-erase; false for a stale handle
+bool removeRig(RigWorld &world, RigHandle rig);
+
+// Dense index of a live rig, -1 for a stale or null handle
+int rigIndex(const RigWorld &world, RigHandle rig);
+RigHandle rigHandle(const RigWorld &world, int index);
+inline int rigCount(const RigWorld &world) { return world.Rigs.Count; }
+
+float rigJoint(const RigWorld &world, int index, RigJoint joint);
+// Clamped into the rig's limits
+void setRigJoint(RigWorld &world, int index, RigJoint joint, float value);
+void moveRigJoint(RigWorld &world, int index, RigJoint joint, float delta);
+void setRigLimits(RigWorld &world, int index, const RigLimits &limits);
+
+// Runs function on [first, last) ranges covering every rig as jobs, first always a multiple
+// of RigWorldChunk; returns once every range is done
+typedef void (*RigRangeFunction)(RigWorld &world, int first, int last, void *data);
+void parallelForRigs(RigWorld &world, JobSystem &jobs, RigRangeFunction function, void *data);
+
+// Clamps the joints of [first, last) into their limits and recomputes their world matrices
+void updateRigRange(RigWorld &world, int first, int last);
+void updateRigWorld(RigWorld &world, JobSystem &jobs);
+
+// Scaling of a joint step plus updateRigWorld() from 1 to maxThreads threads (0 : every
+// hardware thread) on 10k, 100k and 1M rigs, prints ms per update and the speedup over one
+void benchmarkRigWorld(int maxThreads);
+
+#endif
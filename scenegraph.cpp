@@ -0,0 +1,81 @@
+#include <assert.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "scenegraph.hpp"
+
+int SceneGraph::addNode(int parent, glm::vec3 translation, glm::quat rotation, glm::vec3 scale, glm::vec3 offset)
+{
+	// Parents must already exist so the update pass can run front to back
+	assert(parent < size());
+
+	Parent.push_back(parent);
+	Translation.push_back(translation);
+	Rotation.push_back(rotation);
+	Scale.push_back(scale);
+	Offset.push_back(offset);
+	World.push_back(glm::mat4(1.0));
+	Dirty.push_back(1);
+
+	return size() - 1;
+}
+
+void SceneGraph::setTranslation(int node, glm::vec3 translation)
+{
+	if (Translation[node] != translation) {
+		Translation[node] = translation;
+		Dirty[node] = 1;
+	}
+}
+
+void SceneGraph::setRotation(int node, glm::quat rotation)
+{
+	if (Rotation[node] != rotation) {
+		Rotation[node] = rotation;
+		Dirty[node] = 1;
+	}
+}
+
+void SceneGraph::setScale(int node, glm::vec3 scale)
+{
+	if (Scale[node] != scale) {
+		Scale[node] = scale;
+		Dirty[node] = 1;
+	}
+}
+
+int SceneGraph::updateWorldMatrices(void)
+{
+	int recomputed = 0;
+	const int count = size();
+
+	for (int i = 0; i < count; i++) {
+		const int parent = Parent[i];
+
+		// A recomputed parent invalidates the whole subtree below it
+		if (parent >= 0 && Dirty[parent])
+			Dirty[i] = 1;
+		if (!Dirty[i])
+			continue;
+
+		glm::mat4 local = glm::translate(glm::mat4(1.0), Translation[i]);
+		local = local * glm::mat4_cast(Rotation[i]);
+		local = glm::scale(local, Scale[i]);
+		local = glm::translate(local, Offset[i]);
+
+		World[i] = (parent >= 0) ? World[parent] * local : local;
+		recomputed++;
+	}
+
+	// Flags can only be cleared once every child has seen its parent's state
+	if (recomputed > 0) {
+		for (int i = 0; i < count; i++)
+			Dirty[i] = 0;
+	}
+
+	return recomputed;
+}
+
+glm::quat axisRotation(float angle, glm::vec3 axis)
+{
+	return glm::angleAxis(angle, axis);
+}
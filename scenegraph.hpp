@@ -0,0 +1,43 @@
+#ifndef SCENEGRAPH_HPP
+#define SCENEGRAPH_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Flat scene graph. Nodes are stored parent-before-child in parallel arrays, so a
+// single forward pass resolves every world matrix. A node's world matrix is only
+// recomputed when its own local transform or one of its ancestors changed.
+//
+// Local transform of a node : Translate(Translation) * Rotate(Rotation) * Scale(Scale) * Translate(Offset)
+// Offset moves the node's geometry (and its children) out from the joint pivot.
+struct SceneGraph {
+	std::vector<int> Parent;			// index of the parent node, -1 for roots
+	std::vector<glm::vec3> Translation;
+	std::vector<glm::quat> Rotation;
+	std::vector<glm::vec3> Scale;
+	std::vector<glm::vec3> Offset;
+	std::vector<glm::mat4> World;		// cached world matrices, valid after updateWorldMatrices()
+	std::vector<unsigned char> Dirty;	// local transform changed since the last update
+
+	int addNode(int parent,
+		glm::vec3 translation = glm::vec3(0.0f),
+		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+		glm::vec3 scale = glm::vec3(1.0f),
+		glm::vec3 offset = glm::vec3(0.0f));
+
+	// Setters only dirty the node when the value actually changes
+	void setTranslation(int node, glm::vec3 translation);
+	void setRotation(int node, glm::quat rotation);
+	void setScale(int node, glm::vec3 scale);
+
+	// Recompute stale world matrices; returns the number of matrices recomputed
+	int updateWorldMatrices(void);
+
+	int size(void) const { return (int)Parent.size(); }
+};
+
+// Quaternion for a rotation of angle (radians) around axis
+glm::quat axisRotation(float angle, glm::vec3 axis);
+
+#endif
@@ -0,0 +1,61 @@
+#include "scratcharena.hpp"
+
+static void addScratchBlock(ScratchArena &arena, size_t size)
+{
+	ScratchBlock block;
+	block.Data = new unsigned char[size];
+	block.Size = size;
+	arena.Blocks.push_back(block);
+	arena.Used = 0;
+	arena.BlockAllocations++;
+}
+
+void initScratchArena(ScratchArena &arena)
+{
+	arena.Blocks.clear();
+	arena.Used = 0;
+	arena.Allocated = 0;
+	arena.Peak = 0;
+	arena.BlockAllocations = 0;
+}
+
+void freeScratchArena(ScratchArena &arena)
+{
+	for (size_t i = 0; i < arena.Blocks.size(); i++)
+		delete[] arena.Blocks[i].Data;
+	arena.Blocks.clear();
+	arena.Used = 0;
+	arena.Allocated = 0;
+}
+
+void *scratchAlloc(ScratchArena &arena, size_t bytes)
+{
+	bytes = (bytes + ScratchAlignment - 1) / ScratchAlignment * ScratchAlignment;
+	if (arena.Blocks.empty() || arena.Used + bytes > arena.Blocks.back().Size) {
+		// Each new block at least doubles the arena, a load needs few of them
+		size_t size = arena.Blocks.empty() ? ScratchBlockSize : 2 * arena.Blocks.back().Size;
+		while (size < bytes)
+			size *= 2;
+		addScratchBlock(arena, size);
+	}
+
+	void *memory = arena.Blocks.back().Data + arena.Used;
+	arena.Used += bytes;
+	arena.Allocated += bytes;
+	if (arena.Allocated > arena.Peak)
+		arena.Peak = arena.Allocated;
+	return memory;
+}
+
+void resetScratchArena(ScratchArena &arena)
+{
+	if (arena.Blocks.size() > 1) {
+		// The tails the blocks left unused are not needed again, only the bytes handed out
+		for (size_t i = 0; i < arena.Blocks.size(); i++)
+			delete[] arena.Blocks[i].Data;
+		arena.Blocks.clear();
+		addScratchBlock(arena, arena.Peak > ScratchBlockSize ? arena.Peak : ScratchBlockSize);
+	}
+	arena.Used = 0;
+	arena.Allocated = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef SCRATCHARENA_HPP
+#define SCRATCHARENA_HPP
+
+#include <stddef.h>
+#include <vector>
+
+// Linear allocator for the temporaries of one mesh load.
+// Allocation bumps a pointer through large blocks and nothing is freed on its own;
+// resetScratchArena() drops everything at once. A reset after a load that needed more
+// than one block replaces them with a single block as large as the peak use, so an arena
+// reused across loads settles at one allocation and then stops allocating at all.
+
+const size_t ScratchBlockSize = 256 * 1024;
+const size_t ScratchAlignment = 16;
+
+struct ScratchBlock {
+	unsigned char *Data;
+	size_t Size;
+};
+
+struct ScratchArena {
+	std::vector<ScratchBlock> Blocks;
+	size_t Used;				// bytes used in the last block
+	size_t Allocated;			// bytes handed out since the last reset
+	size_t Peak;				// most bytes handed out between two resets
+	unsigned int BlockAllocations;
+};
+
+void initScratchArena(ScratchArena &arena);
+void freeScratchArena(ScratchArena &arena);
+
+// ScratchAlignment aligned, valid until the next reset
+void *scratchAlloc(ScratchArena &arena, size_t bytes);
+
+template <class T>
+T *scratchArray(ScratchArena &arena, size_t count)
+{
+	return (T*)scratchAlloc(arena, sizeof(T) * count);
+}
+
+void resetScratchArena(ScratchArena &arena);
+
+#endif
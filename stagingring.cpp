@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <string.h>
+#include <GL/glew.h>
+
+#include "stagingring.hpp"
+
+void createStagingRing(StagingRing &ring, size_t capacity)
+{
+	ring.Head = 0;
+	ring.Mapped = NULL;
+	ring.Fence = 0;
+	ring.Unfenced = false;
+	ring.BytesStaged = 0;
+	ring.Waits = 0;
+	ring.Capacity = (capacity + StagingAlignment - 1) / StagingAlignment * StagingAlignment;
+	ring.Persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+
+	glGenBuffers(1, &ring.Buffer);
+	glBindBuffer(GL_COPY_READ_BUFFER, ring.Buffer);
+	if (ring.Persistent) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_READ_BUFFER, ring.Capacity, NULL, flags);
+		ring.Mapped = (unsigned char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, ring.Capacity, flags);
+		if (ring.Mapped == NULL) {
+			// Immutable storage can't be respecified, start over with a mutable buffer
+			fprintf(stderr, "ERROR: Persistent staging map failed, orphaning instead\n");
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glDeleteBuffers(1, &ring.Buffer);
+			glGenBuffers(1, &ring.Buffer);
+			glBindBuffer(GL_COPY_READ_BUFFER, ring.Buffer);
+			ring.Persistent = false;
+		}
+	}
+	if (!ring.Persistent)
+		glBufferData(GL_COPY_READ_BUFFER, ring.Capacity, NULL, GL_STREAM_COPY);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void destroyStagingRing(StagingRing &ring)
+{
+	if (ring.Fence != 0)
+		glDeleteSync(ring.Fence);
+	// Deleting the buffer unmaps it
+	glDeleteBuffers(1, &ring.Buffer);
+	ring.Buffer = 0;
+	ring.Mapped = NULL;
+	ring.Fence = 0;
+	std::vector<unsigned char>().swap(ring.Scratch);
+}
+
+void fenceStaging(StagingRing &ring)
+{
+	if (!ring.Unfenced)
+		return;
+	if (ring.Fence != 0)
+		glDeleteSync(ring.Fence);
+	ring.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	ring.Unfenced = false;
+}
+
+// Starts over at the front once every copy out of the ring has finished
+static void wrapStaging(StagingRing &ring)
+{
+	ring.Head = 0;
+	if (!ring.Persistent) {
+		// The driver hands out fresh storage, the old one lives on until its copies are done
+		glBindBuffer(GL_COPY_READ_BUFFER, ring.Buffer);
+		glBufferData(GL_COPY_READ_BUFFER, ring.Capacity, NULL, GL_STREAM_COPY);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		return;
+	}
+
+	fenceStaging(ring);
+	if (ring.Fence == 0)
+		return;
+	GLenum status = glClientWaitSync(ring.Fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		ring.Waits++;
+		do {
+			status = glClientWaitSync(ring.Fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		} while (status == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(ring.Fence);
+	ring.Fence = 0;
+}
+
+unsigned char *mapStaging(StagingRing &ring, size_t size, size_t &reserved)
+{
+	reserved = size;
+	if (reserved > ring.Capacity)
+		reserved = ring.Capacity;
+	if (ring.Head + reserved > ring.Capacity)
+		wrapStaging(ring);
+
+	if (ring.Persistent)
+		return ring.Mapped + ring.Head;
+
+	// Nothing in flight reads past Head since the last orphan
+	glBindBuffer(GL_COPY_READ_BUFFER, ring.Buffer);
+	ring.Mapped = (unsigned char*)glMapBufferRange(GL_COPY_READ_BUFFER, ring.Head, reserved,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	if (ring.Mapped != NULL)
+		return ring.Mapped;
+
+	// copyStaging() falls back to glBufferSubData
+	ring.Scratch.resize(reserved);
+	return &ring.Scratch[0];
+}
+
+void copyStaging(StagingRing &ring, size_t size, GLuint buffer, size_t offset)
+{
+	if (!ring.Persistent && ring.Mapped == NULL) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, &ring.Scratch[0]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		ring.BytesStaged += size;
+		return;
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, ring.Buffer);
+	if (!ring.Persistent) {
+		// A buffer can't be copied from while it is mapped without the persistent bit
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		ring.Mapped = NULL;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, ring.Head, offset, size);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	ring.Head += (size + StagingAlignment - 1) / StagingAlignment * StagingAlignment;
+	ring.Unfenced = true;
+	ring.BytesStaged += size;
+}
+
+void stageUpload(StagingRing &ring, const void *data, size_t size, GLuint buffer, size_t offset)
+{
+	const unsigned char *bytes = (const unsigned char*)data;
+	while (size > 0) {
+		size_t chunk;
+		unsigned char *staging = mapStaging(ring, size, chunk);
+		memcpy(staging, bytes, chunk);
+		copyStaging(ring, chunk, buffer, offset);
+		bytes += chunk;
+		offset += chunk;
+		size -= chunk;
+	}
+}
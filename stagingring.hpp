@@ -0,0 +1,48 @@
+#ifndef STAGINGRING_HPP
+#define STAGINGRING_HPP
+
+#include <stddef.h>
+#include <vector>
+#include <GL/glew.h>
+
+// Upload staging for static buffers.
+// Data is written into a ring of mapped staging memory and moved into its destination
+// buffer with glCopyBufferSubData, so the destination is never mapped or respecified.
+// With GL 4.4 or ARB_buffer_storage the ring is mapped once, persistently and coherently,
+// and a fence guards it against being overwritten while the GPU still copies out of it.
+// Without, each chunk is mapped unsynchronized and the storage is orphaned on wrap.
+
+const size_t StagingAlignment = 64;		// GL_MIN_MAP_BUFFER_ALIGNMENT is at least this
+
+struct StagingRing {
+	GLuint Buffer;
+	size_t Capacity;
+	size_t Head;				// where the next chunk goes
+	bool Persistent;
+	unsigned char *Mapped;		// the whole ring when persistent, the open chunk otherwise
+	GLsync Fence;				// after the last fenced copy, 0 if none
+	bool Unfenced;				// copies issued since the last fence
+	std::vector<unsigned char> Scratch;	// stands in for a chunk that couldn't be mapped
+
+	size_t BytesStaged;			// totals for the stats
+	unsigned int Waits;
+};
+
+// Needs a current GL context
+void createStagingRing(StagingRing &ring, size_t capacity);
+void destroyStagingRing(StagingRing &ring);
+
+// Reserves up to size bytes of staging memory and returns where to write them.
+// reserved is size, or a multiple of StagingAlignment when size exceeds the ring.
+unsigned char *mapStaging(StagingRing &ring, size_t size, size_t &reserved);
+
+// Copies the first size bytes written since mapStaging() to buffer at offset
+void copyStaging(StagingRing &ring, size_t size, GLuint buffer, size_t offset);
+
+// Stages and copies data in as many chunks as it takes
+void stageUpload(StagingRing &ring, const void *data, size_t size, GLuint buffer, size_t offset);
+
+// Fences the copies issued so far, the next wrap only waits for them if they are still running
+void fenceStaging(StagingRing &ring);
+
+#endif
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <string.h>
+#include <GL/glew.h>
+
+#include "uniformring.hpp"
+
+void createUniformRing(UniformRing &ring, size_t capacity)
+{
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ring.Alignment);
+	if (ring.Alignment < 1)
+		ring.Alignment = 256;
+	ring.Capacity = capacity;
+	ring.Head = ring.Base = 0;
+	ring.Staging.clear();
+
+	glGenBuffers(1, &ring.Buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, ring.Buffer);
+	glBufferData(GL_UNIFORM_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void destroyUniformRing(UniformRing &ring)
+{
+	glDeleteBuffers(1, &ring.Buffer);
+	ring.Buffer = 0;
+	ring.Staging.clear();
+}
+
+void beginUniformRing(UniformRing &ring)
+{
+	ring.Staging.clear();
+}
+
+size_t pushUniforms(UniformRing &ring, const void *block, size_t size)
+{
+	const size_t alignment = ring.Alignment;
+	const size_t offset = (ring.Staging.size() + alignment - 1) / alignment * alignment;
+	ring.Staging.resize(offset + size);
+	memcpy(&ring.Staging[offset], block, size);
+	return offset;
+}
+
+void uploadUniformRing(UniformRing &ring)
+{
+	const size_t size = ring.Staging.size();
+	if (size == 0)
+		return;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, ring.Buffer);
+
+	// Grow if one frame no longer fits twice, the old storage is orphaned either way
+	if (2 * size > ring.Capacity) {
+		while (2 * size > ring.Capacity)
+			ring.Capacity *= 2;
+		ring.Head = ring.Capacity;
+	}
+
+	// Wrapping around : fresh storage rather than waiting for the GPU to finish with the old one
+	const size_t alignment = ring.Alignment;
+	size_t base = (ring.Head + alignment - 1) / alignment * alignment;
+	if (base + size > ring.Capacity) {
+		glBufferData(GL_UNIFORM_BUFFER, ring.Capacity, NULL, GL_STREAM_DRAW);
+		base = 0;
+	}
+
+	void *mapped = glMapBufferRange(GL_UNIFORM_BUFFER, base, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (mapped != NULL) {
+		memcpy(mapped, &ring.Staging[0], size);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+	}
+	else {
+		glBufferSubData(GL_UNIFORM_BUFFER, base, size, &ring.Staging[0]);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	ring.Base = base;
+	ring.Head = base + size;
+}
+
+void bindUniforms(const UniformRing &ring, GLuint binding, size_t offset, size_t size)
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, ring.Buffer, ring.Base + offset, size);
+}
@@ -0,0 +1,39 @@
+#ifndef UNIFORMRING_HPP
+#define UNIFORMRING_HPP
+
+#include <stddef.h>
+#include <vector>
+#include <GL/glew.h>
+
+// Uniform block data for a whole frame, written once into one uniform buffer.
+// Blocks are pushed on the CPU at GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, uploaded together and
+// then bound per draw with glBindBufferRange. Each upload goes after the previous one
+// through an unsynchronized map, so the GPU can still be reading older frames; the
+// buffer is only orphaned when the ring wraps around.
+
+struct UniformRing {
+	GLuint Buffer;
+	GLint Alignment;
+	size_t Capacity;				// bytes of GPU storage
+	size_t Head;					// where the next upload goes
+	size_t Base;					// where the last upload went, pushed offsets are relative to it
+	std::vector<unsigned char> Staging;
+};
+
+// Needs a current GL context
+void createUniformRing(UniformRing &ring, size_t capacity);
+void destroyUniformRing(UniformRing &ring);
+
+// Starts collecting a new frame of blocks
+void beginUniformRing(UniformRing &ring);
+
+// Copies a block in and returns its offset within the frame
+size_t pushUniforms(UniformRing &ring, const void *block, size_t size);
+
+// Writes the collected blocks to the GPU
+void uploadUniformRing(UniformRing &ring);
+
+// Binds a pushed block of the last upload to a uniform block binding point
+void bindUniforms(const UniformRing &ring, GLuint binding, size_t offset, size_t size);
+
+#endif